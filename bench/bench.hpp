@@ -0,0 +1,25 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+
+// Runs `f` `reps` times and returns the best wall time of a single run, in
+// nanoseconds. Taking the minimum filters out scheduler noise.
+template <typename F> double best_of(int reps, F f) {
+  double best = 1e300;
+  for (int i = 0; i < reps; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    if (ns < best) {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+// Keeps the compiler from optimizing away a result.
+template <typename T> void keep(const T &value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
@@ -0,0 +1,170 @@
+// Stress test of the lock-free handoffs between the UI and audio threads:
+// CommandQueue (UI to audio), TripleBuffer and Overview (audio to UI). One thread
+// plays each side as fast as it can, and every value that comes across is
+// checked for order and tearing. Build it as `commands-tsan` (make tsan) to
+// have ThreadSanitizer check the synchronisation too; it exits non-zero on
+// any failure, so it can run in CI.
+//
+//   bench/commands [seconds]
+
+#include "commands.hpp"
+#include "overview.hpp"
+#include "snapshot.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Big enough that a torn copy would show
+struct Payload {
+  uint64_t seq = 0;
+  uint64_t copies[7] = {};
+};
+
+static Payload make(uint64_t seq) {
+  Payload p;
+  p.seq = seq;
+  for (uint64_t &c : p.copies) {
+    c = seq * 2654435761u;
+  }
+  return p;
+}
+
+static bool intact(const Payload &p) {
+  for (uint64_t c : p.copies) {
+    if (c != p.seq * 2654435761u) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The UI thread sends commands in sequence, retrying when the queue is full;
+// the audio thread applies them and expects every one, in order.
+static bool commandQueue(double seconds) {
+  CommandQueue<Payload> queue;
+  std::atomic<bool> done{false};
+  uint64_t sent = 0, applied = 0, errors = 0;
+  std::thread audio([&] {
+    while (true) {
+      bool last = done.load(std::memory_order_acquire);
+      uint64_t before = applied;
+      queue.apply([&](const Payload &p) {
+        if (p.seq != applied + 1 or not intact(p)) {
+          errors++;
+        }
+        applied = p.seq;
+      });
+      if (last) {
+        break;
+      }
+      if (applied == before) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  auto end = std::chrono::steady_clock::now() +
+             std::chrono::duration<double>(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    for (int i = 0; i < 1000; i++) {
+      if (queue.send(make(sent + 1))) {
+        sent++;
+      } else {
+        std::this_thread::yield(); // the queue is full
+      }
+    }
+  }
+  done.store(true, std::memory_order_release);
+  audio.join();
+  printf("command queue  %12llu sent %12llu applied %6llu errors\n",
+         (unsigned long long)sent, (unsigned long long)applied,
+         (unsigned long long)errors);
+  return errors == 0 and applied == sent;
+}
+
+// The audio thread publishes a new version as often as it can; the UI thread
+// reads, and must never see a torn version or one older than the last.
+static bool tripleBuffer(double seconds) {
+  TripleBuffer<Payload> buffer;
+  std::atomic<bool> done{false};
+  uint64_t published = 0;
+  std::thread audio([&] {
+    while (not done.load(std::memory_order_relaxed)) {
+      buffer.write() = make(++published);
+      buffer.publish();
+    }
+  });
+  uint64_t reads = 0, last = 0, errors = 0;
+  auto end = std::chrono::steady_clock::now() +
+             std::chrono::duration<double>(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    for (int i = 0; i < 1000; i++, reads++) {
+      const Payload &p = buffer.read();
+      if (p.seq < last or not intact(p)) {
+        errors++;
+      }
+      last = p.seq;
+    }
+  }
+  done.store(true, std::memory_order_relaxed);
+  audio.join();
+  printf("triple buffer  %12llu sent %12llu read    %6llu errors\n",
+         (unsigned long long)published, (unsigned long long)reads,
+         (unsigned long long)errors);
+  return errors == 0;
+}
+
+// The audio thread records a take of a sine, starting over now and then; the
+// UI thread draws it, and must only ever see ranges within the sine's.
+static bool overview(double seconds) {
+  Overview overview;
+  std::atomic<bool> done{false};
+  uint64_t pushed = 0;
+  std::thread audio([&] {
+    float block[64];
+    while (not done.load(std::memory_order_relaxed)) {
+      for (int i = 0; i < 64; i++, pushed++) {
+        block[i] = sinf(pushed * 0.001f);
+      }
+      overview.push(block, 64, 1);
+      if (pushed % (1 << 24) == 0) {
+        overview.reset();
+      }
+    }
+  });
+  std::vector<MinMax> columns;
+  uint64_t reads = 0, errors = 0;
+  auto end = std::chrono::steady_clock::now() +
+             std::chrono::duration<double>(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    for (int i = 0; i < 100; i++, reads++) {
+      if (not overview.read(300, columns)) {
+        continue;
+      }
+      for (const MinMax &column : columns) {
+        if (column.min < -1 or column.max > 1) {
+          errors++;
+        }
+      }
+    }
+  }
+  done.store(true, std::memory_order_relaxed);
+  audio.join();
+  printf("overview       %12llu sent %12llu read    %6llu errors\n",
+         (unsigned long long)pushed, (unsigned long long)reads,
+         (unsigned long long)errors);
+  return errors == 0;
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 2;
+  bool ok = commandQueue(seconds);
+  ok = tripleBuffer(seconds) and ok;
+  ok = overview(seconds) and ok;
+  printf(ok ? "OK\n" : "FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,80 @@
+// Compares the block conversion kernels against the original to_bytes(), which
+// took the whole take by value and grew a byte vector with push_back.
+
+#include "bench.hpp"
+#include "convert.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+// The pre-kernel implementation, kept verbatim as the baseline.
+static std::vector<uint8_t> to_bytes(SampleFmt format,
+                                     std::vector<float> buffer) {
+  std::vector<uint8_t> byte_buffer;
+  for (float x : buffer) {
+    if (format == SampleFmt::PCM_U8) {
+      uint8_t sample = 127 * (x / 12 + 1);
+      byte_buffer.push_back(sample);
+    } else if (format == SampleFmt::PCM_S16) {
+      int16_t sample = 32766 * (x / 12);
+      uint8_t const *casted = reinterpret_cast<uint8_t const *>(&sample);
+      byte_buffer.push_back(casted[0]);
+      byte_buffer.push_back(casted[1]);
+    } else if (format == SampleFmt::FLOAT_32) {
+      float sample = x / 12;
+      uint8_t const *casted = reinterpret_cast<uint8_t const *>(&sample);
+      byte_buffer.push_back(casted[0]);
+      byte_buffer.push_back(casted[1]);
+      byte_buffer.push_back(casted[2]);
+      byte_buffer.push_back(casted[3]);
+    }
+  }
+  return byte_buffer;
+}
+
+int main() {
+  // 60 seconds of stereo audio at 48kHz, slightly over full scale so the
+  // clipping paths get exercised.
+  const size_t n = 60 * 48000 * 2;
+  std::vector<float> input(n);
+  for (size_t i = 0; i < n; i++) {
+    input[i] = 13.0f * sinf(i * 0.001f) + (rand() % 100) * 0.001f;
+  }
+  std::vector<uint8_t> out(n * 4), reference(n * 4);
+
+  const SampleFmt formats[] = {PCM_U8, PCM_S16, FLOAT_32};
+  printf("%-14s %12s %12s %12s %12s %8s\n", "format", "to_bytes", "scalar",
+         "kernel", "+dither", "speedup");
+  for (SampleFmt format : formats) {
+    // The kernels must agree with the scalar reference bit for bit.
+    convert_scalar(format, input.data(), reference.data(), n);
+    convert(format, input.data(), out.data(), n);
+    for (size_t i = 0; i < n * sampleBytes(format); i++) {
+      if (out[i] != reference[i]) {
+        printf("%s: kernel disagrees with scalar at byte %zu\n",
+               toString(format), i);
+        return 1;
+      }
+    }
+
+    double legacy = best_of(5, [&] { keep(to_bytes(format, input)); });
+    double scalar = best_of(5, [&] {
+      convert_scalar(format, input.data(), out.data(), n);
+      keep(out[0]);
+    });
+    double kernel = best_of(5, [&] {
+      convert(format, input.data(), out.data(), n);
+      keep(out[0]);
+    });
+    Dither dither;
+    double dithered = best_of(5, [&] {
+      convert(format, input.data(), out.data(), n, &dither);
+      keep(out[0]);
+    });
+    printf("%-14s %9.2f ns %9.2f ns %9.2f ns %9.2f ns %7.1fx\n",
+           toString(format), legacy / n, scalar / n, kernel / n, dithered / n,
+           legacy / kernel);
+  }
+  return 0;
+}
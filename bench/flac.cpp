@@ -0,0 +1,104 @@
+// Measures the FLAC encoder on the kinds of signal the plugin records: how
+// many times faster than real time it encodes, and how small the result is
+// compared to 16 bit WAV.
+
+#include "bench.hpp"
+#include "convert.hpp"
+#include "flacencoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+static const int SAMPLE_RATE = 48000;
+static const int NUM_CHANNELS = 2;
+
+// What the NoiseGenerator outputs: a new rand() sample every `clock_length`
+// frames, held in between.
+static float held(int clock_length, bool brownian, size_t i, float &last) {
+  if (i % clock_length == 0) {
+    float sample = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+    if (brownian) {
+      last = std::min(std::max(0.0f, last + 2 * (sample - 0.5f)), 10.0f);
+    } else {
+      last = sample * 10.0f;
+    }
+  }
+  return last;
+}
+
+// Throws the encoded bytes away, so only the encoder is measured
+struct NullSink : Sink {
+  bool open(const char *) override { return true; }
+  void write(const void *, size_t n) override { length += n; }
+  void rewrite(uint64_t, const void *, size_t) override {}
+  void flush() override {}
+  void close() override {}
+};
+
+int main() {
+  // 30 seconds of stereo audio, in volts
+  const size_t frames = 30 * SAMPLE_RATE;
+  const size_t n = frames * NUM_CHANNELS;
+  std::vector<float> input(n);
+  std::vector<int16_t> pcm(n);
+
+  struct Signal {
+    const char *name;
+    float (*sample)(size_t i, int channel);
+  };
+  static float last[NUM_CHANNELS];
+  const Signal signals[] = {
+      {"silence", [](size_t, int) { return 0.0f; }},
+      {"sine", [](size_t i, int c) {
+         return 5.0f * sinf(2 * float(M_PI) * 440 * (i + c * 10) / SAMPLE_RATE);
+       }},
+      {"white", [](size_t, int) {
+         return 24.0f * (rand() / float(RAND_MAX) - 0.5f);
+       }},
+      {"noise gen x1", [](size_t i, int c) {
+         return held(1, false, i, last[c]);
+       }},
+      {"noise gen x10", [](size_t i, int c) {
+         return held(10, false, i, last[c]);
+       }},
+      {"brownian x1", [](size_t i, int c) {
+         return held(1, true, i, last[c]);
+       }},
+      {"brownian x10", [](size_t i, int c) {
+         return held(10, true, i, last[c]);
+       }},
+  };
+
+  printf("%-14s %10s %10s %8s\n", "signal", "realtime", "ratio", "effort");
+  for (const Signal &signal : signals) {
+    std::fill(last, last + NUM_CHANNELS, 0.0f);
+    for (size_t i = 0; i < frames; i++) {
+      for (int c = 0; c < NUM_CHANNELS; c++) {
+        input[i * NUM_CHANNELS + c] = signal.sample(i, c);
+      }
+    }
+    convert(SampleFmt::PCM_S16, input.data(),
+            reinterpret_cast<uint8_t *>(pcm.data()), n);
+
+    uint64_t size = 0;
+    int effort = 0;
+    double ns = best_of(3, [&] {
+      NullSink sink;
+      FlacEncoder encoder(sink, NUM_CHANNELS, SAMPLE_RATE);
+      // In blocks of the size the disk writer hands over
+      for (size_t i = 0; i < frames; i += 8192) {
+        encoder.write(pcm.data() + i * NUM_CHANNELS,
+                      std::min<size_t>(8192, frames - i));
+      }
+      encoder.finish();
+      size = sink.size();
+      effort = encoder.effort();
+    });
+    double seconds = double(frames) / SAMPLE_RATE;
+    printf("%-14s %9.0fx %10.3f %8d\n", signal.name, seconds / (ns * 1e-9),
+           double(size) / (n * sizeof(int16_t)), effort);
+  }
+  return 0;
+}
@@ -0,0 +1,222 @@
+// Drives the DSP cores of the modules the way the engine does, a frame at a
+// time, for capacity planning and to catch regressions. For each module,
+// sample rate and channel count it reports the cost per frame, the time
+// blocks of BLOCK frames take (the share of an audio callback the module
+// needs, median to worst) and the heap allocations made while running,
+// which should be none.
+//
+//   bench/modules [seconds]
+//
+// The Recorders write their takes into a temporary directory, which is
+// removed afterwards. They run many times faster than real time, so if the
+// disk can't keep up some frames are dropped (and cost less than written
+// ones); the last column counts them.
+//
+// Built with `make PROFILE=1`, every frame is timed the way the modules'
+// step() are then, to show what the timing costs.
+
+#include "bench.hpp"
+#include "noise.hpp"
+#include "pushbutton.hpp"
+#include "recordercore.hpp"
+#include "timing.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <dirent.h>
+#include <new>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Frames per block, as in a typical audio callback. The modules themselves
+// work in blocks of STEP_BLOCK.
+static const int BLOCK = 64;
+static const int RATES[] = {44100, 48000, 96000, 192000};
+
+// Heap allocations by the thread running a benchmark, while it runs. The
+// disk writer's thread allocates as it opens files, which is fine.
+static thread_local bool counting = false;
+static size_t allocations = 0;
+
+#ifdef MICROTOOLS_PROFILE
+// Where the frames of the Push Buttons and noise are timed
+static StepTiming timing;
+#endif
+
+void *operator new(size_t size) {
+  if (counting) {
+    allocations++;
+  }
+  void *p = malloc(size);
+  if (not p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+// Runs `block` (which processes BLOCK frames) over `frames` frames and
+// prints a row of results, leaving the line open for more.
+template <typename F>
+static void run(const char *name, int rate, int channels, uint64_t frames,
+                F block) {
+  std::vector<double> latencies;
+  latencies.reserve(frames / BLOCK + 1);
+  allocations = 0;
+  counting = true;
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < frames; i += BLOCK) {
+    auto before = std::chrono::steady_clock::now();
+    block();
+    auto after = std::chrono::steady_clock::now();
+    latencies.push_back(
+        std::chrono::duration<double, std::micro>(after - before).count());
+  }
+  auto end = std::chrono::steady_clock::now();
+  counting = false;
+
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  std::sort(latencies.begin(), latencies.end());
+  size_t n = latencies.size();
+  printf("%-18s %6d %3d %9.2f %8.2f %8.2f %8.2f %8.2f %6zu", name, rate,
+         channels, ns / frames, latencies[n / 2], latencies[n * 99 / 100],
+         latencies[n * 999 / 1000], latencies.back(), allocations);
+}
+
+// The PushButton module's step(), with the buttons held down by turns so
+// that a ramp is almost always running. Every channel changes every
+// `period` frames.
+template <int CHANNELS> static void pushButton(int rate, uint64_t frames) {
+  const float slew = 0.002f * rate; // the default 2 ms
+  const uint64_t period = 2 * slew;
+  PushButtonCore<CHANNELS> core;
+  OutputBlock<CHANNELS> block;
+  bool ramping = false;
+  float outputs[CHANNELS] = {};
+  uint64_t frame = 0;
+  run("push button", rate, CHANNELS, frames, [&] {
+    for (int f = 0; f < BLOCK; f++, frame++) {
+      TIME_STEP(timing);
+      if (block.due()) {
+        for (int i = 0; i < CHANNELS; i++) {
+          bool state = (frame + i * period / CHANNELS) / period % 2;
+          core.set(i, state ? 5.0f : 0.0f, slew);
+        }
+        ramping = core.process(block.fill(), STEP_BLOCK);
+      }
+      const float *values = block.next();
+      if (ramping) {
+        std::copy(values, values + CHANNELS, outputs);
+      }
+    }
+    keep(outputs);
+  });
+  printf("\n");
+}
+
+// `channels` NoiseGenerators, each with its own generator, at the shortest
+// period (a new sample every frame) and the default volume.
+static void noise(const char *name, NoiseType type, int rate, int channels,
+                  uint64_t frames) {
+  std::vector<Random> randoms;
+  for (int c = 0; c < channels; c++) {
+    randoms.emplace_back(c + 1);
+  }
+  std::vector<NoiseVoice> voices(channels);
+  std::vector<OutputBlock<1>> blocks(channels);
+  std::vector<float> outputs(channels);
+  float delta = clockDelta(1.0f / rate, clockLength(0.0f, false));
+  float width = POISSON_MIN_WIDTH * rate;
+  run(name, rate, channels, frames, [&] {
+    for (int f = 0; f < BLOCK; f++) {
+      TIME_STEP(timing);
+      for (int c = 0; c < channels; c++) {
+        if (blocks[c].due()) {
+          voices[c].process(randoms[c], type, delta, 1.0f, width,
+                            blocks[c].fill(), STEP_BLOCK);
+        }
+        outputs[c] = *blocks[c].next();
+      }
+    }
+    keep(outputs[0]);
+  });
+  printf("\n");
+}
+
+// A Recorder recording `channels` channels of 32 bit float for the whole run
+static void recorder(int rate, int channels, uint64_t frames) {
+  RecorderCore core(MAX_CHANNELS, rate);
+  core.num_channels = channels;
+  float frame[MAX_CHANNELS];
+  float x = 0.0f;
+  // Start the take outside of the timing, as the writer opens the file
+  core.stepRecorder(true, frame);
+  run("recorder", rate, channels, frames, [&] {
+    for (int f = 0; f < BLOCK; f++) {
+      TIME_STEP(core.timing);
+      for (int c = 0; c < MAX_CHANNELS; c++) {
+        frame[c] = x;
+      }
+      x = x < 5.0f ? x + 0.001f : -5.0f;
+      core.stepRecorder(true, frame);
+    }
+  });
+  printf(" %9llu\n", (unsigned long long)(core.writer.overruns() / channels));
+  core.stepRecorder(false, frame);
+}
+
+// Removes the files in `directory`, then the directory
+static void removeAll(const std::string &directory) {
+  if (DIR *dir = opendir(directory.c_str())) {
+    while (struct dirent *entry = readdir(dir)) {
+      std::string name = entry->d_name;
+      if (name != "." and name != "..") {
+        unlink((directory + "/" + name).c_str());
+      }
+    }
+    closedir(dir);
+  }
+  rmdir(directory.c_str());
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 10;
+
+  printf("%-18s %6s %3s %9s %8s %8s %8s %8s %6s %9s\n", "module", "rate",
+         "ch", "ns/frame", "us/blk", "99%", "99.9%", "worst", "allocs",
+         "dropped");
+  for (int rate : RATES) {
+    uint64_t frames = seconds * rate;
+    pushButton<4>(rate, frames);
+    pushButton<8>(rate, frames);
+    pushButton<16>(rate, frames);
+  }
+  struct {
+    const char *name;
+    NoiseType type;
+  } types[] = {{"noise white", WHITE_NOISE}, {"noise pink", PINK_NOISE},
+               {"noise brownian", BROWNIAN}, {"noise poisson", POISSON_TRIGGER}};
+  for (int rate : RATES) {
+    uint64_t frames = seconds * rate;
+    for (auto &type : types) {
+      noise(type.name, type.type, rate, 1, frames);
+      noise(type.name, type.type, rate, 16, frames);
+    }
+  }
+
+  char directory[] = "/tmp/modules-bench-XXXXXX";
+  if (not mkdtemp(directory) or chdir(directory) != 0) {
+    printf("Couldn't make a directory for the recordings\n");
+    return 1;
+  }
+  for (int rate : RATES) {
+    uint64_t frames = seconds * rate;
+    recorder(rate, 2, frames);
+    recorder(rate, 16, frames);
+  }
+  removeAll(directory);
+  return 0;
+}
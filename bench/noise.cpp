@@ -0,0 +1,37 @@
+// Times each noise colour the NoiseGenerator makes, generated in blocks of 64
+// the way the module does it. Colours should cost about the same as white.
+
+#include "bench.hpp"
+#include "noise.hpp"
+#include "random.hpp"
+
+#include <vector>
+
+static const size_t N = 1 << 20;
+static const size_t BLOCK = 64;
+
+int main() {
+  std::vector<float> out(N);
+  Random random(1);
+  NoiseColourFilter filter;
+
+  printf("%-10s %12s\n", "colour", "ns/sample");
+  auto run = [&](const char *name, void (NoiseColourFilter::*colour)(
+                                       const float *, float *, size_t)) {
+    double ns = best_of(5, [&] {
+      for (size_t i = 0; i < N; i += BLOCK) {
+        random.fill(&out[i], BLOCK);
+        if (colour) {
+          (filter.*colour)(&out[i], &out[i], BLOCK);
+        }
+      }
+      keep(out[N - 1]);
+    });
+    printf("%-10s %12.2f\n", name, ns / N);
+  };
+  run("white", nullptr);
+  run("pink", &NoiseColourFilter::pink);
+  run("blue", &NoiseColourFilter::blue);
+  run("violet", &NoiseColourFilter::violet);
+  return 0;
+}
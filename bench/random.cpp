@@ -0,0 +1,75 @@
+// Compares the per-instance Random generator against the rand() call the
+// NoiseGenerator used to make for every sample. rand() takes a process wide
+// lock in glibc, so it is also timed with several threads (modules) at once.
+
+#include "bench.hpp"
+#include "random.hpp"
+
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <vector>
+
+static const size_t N = 1 << 20;
+static const int THREADS = 4;
+
+// ns per sample when `threads` threads each run `f` over their own buffer at
+// the same time, counting the samples of all threads
+template <typename F> double per_sample(int threads, F f) {
+  std::vector<std::vector<float>> out(threads, std::vector<float>(N));
+  double ns = best_of(5, [&] {
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+      workers.emplace_back([&, t] {
+        f(t, out[t].data());
+        keep(out[t][N - 1]);
+      });
+    }
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  });
+  return ns / (threads * N);
+}
+
+int main() {
+  // Random must give the same sequence whichever path it takes
+  Random a(42), b(42);
+  std::vector<float> x(1001), y(1001);
+  a.uniform();
+  b.uniform();
+  a.fill(x.data(), x.size());
+  for (float &v : y) {
+    v = b.uniform();
+  }
+  if (x != y) {
+    printf("fill() and uniform() disagree!\n");
+    return 1;
+  }
+
+  printf("%-22s %12s %12s\n", "generator", "1 thread", "4 threads");
+  printf("%-22s %12s %12s\n", "", "ns/sample", "ns/sample");
+  auto run = [&](const char *name, std::function<void(int, float *)> f) {
+    printf("%-22s %12.2f %12.2f\n", name, per_sample(1, f),
+           per_sample(THREADS, f));
+  };
+  run("rand()", [](int, float *out) {
+    for (size_t i = 0; i < N; i++) {
+      out[i] = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+    }
+  });
+  run("Random::uniform()", [](int t, float *out) {
+    Random random(t);
+    for (size_t i = 0; i < N; i++) {
+      out[i] = random.uniform();
+    }
+  });
+  run("Random::fill()", [](int t, float *out) {
+    Random random(t);
+    // In blocks, the way the modules use it
+    for (size_t i = 0; i < N; i += 64) {
+      random.fill(out + i, 64);
+    }
+  });
+  return 0;
+}
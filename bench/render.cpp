@@ -0,0 +1,74 @@
+// Renders the NoiseGenerator's DSP offline, as fast as it goes, into a 32 bit
+// float WAV file. The same arguments always give the same file bit for bit,
+// so renders can be checked against golden files, and the time it takes is a
+// reproducible throughput benchmark.
+//
+//   render out.wav [type] [seed] [seconds] [period] [volume] [rate] [width]
+//
+// `type` is white, brown, trigger, pink, blue, violet or poisson. `period`,
+// `volume` and `width` are the knob settings, in volts (the period multiplier
+// is off).
+
+#include "bench.hpp"
+#include "block.hpp"
+#include "convert.hpp"
+#include "noise.hpp"
+#include "wavwriter.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const char *TYPES[] = {"white", "brown",  "trigger", "pink",
+                              "blue",  "violet", "poisson"};
+static const int NUM_TYPES = sizeof(TYPES) / sizeof(TYPES[0]);
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("usage: %s out.wav [type] [seed] [seconds] [period] [volume] "
+           "[rate] [width]\n",
+           argv[0]);
+    return 1;
+  }
+  const char *filename = argv[1];
+  const char *type_name = argc > 2 ? argv[2] : "white";
+  uint32_t seed = argc > 3 ? strtoul(argv[3], nullptr, 0) : 1;
+  double seconds = argc > 4 ? atof(argv[4]) : 10;
+  float period = argc > 5 ? atof(argv[5]) : 0;
+  float volume = argc > 6 ? atof(argv[6]) : 1;
+  int rate = argc > 7 ? atoi(argv[7]) : 44100;
+  float width_knob = argc > 8 ? atof(argv[8]) : 0;
+
+  int type = 0;
+  while (type < NUM_TYPES and strcmp(TYPES[type], type_name) != 0) {
+    type++;
+  }
+  if (type == NUM_TYPES) {
+    printf("Unknown noise type %s\n", type_name);
+    return 1;
+  }
+
+  // What the module does in step(), once per block
+  uint64_t frames = seconds * rate;
+  std::vector<float> out(frames);
+  Random random(seed);
+  NoiseVoice voice;
+  float sample_time = 1.0 / rate; // as Rack computes it
+  float delta = clockDelta(sample_time, clockLength(period, false));
+  float width = POISSON_MIN_WIDTH *
+                powf(POISSON_MAX_WIDTH / POISSON_MIN_WIDTH, width_knob) * rate;
+  double ns = best_of(1, [&] {
+    for (uint64_t i = 0; i < frames; i += STEP_BLOCK) {
+      int n = std::min<uint64_t>(STEP_BLOCK, frames - i);
+      voice.process(random, NoiseType(type), delta, volume, width, &out[i], n);
+    }
+  });
+
+  std::vector<uint8_t> bytes(frames * sampleBytes(SampleFmt::FLOAT_32));
+  convert(SampleFmt::FLOAT_32, out.data(), bytes.data(), frames);
+  writewav(bytes.data(), SampleFmt::FLOAT_32, 1, frames, rate, filename);
+  printf("%s noise, seed %u: %.2f ns/frame, %.0fx realtime\n", TYPES[type],
+         seed, ns / frames, seconds * 1e9 / ns);
+  return 0;
+}
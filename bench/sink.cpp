@@ -0,0 +1,74 @@
+// Measures each disk sink the way the disk writer uses it: a stream of
+// block-sized appends with a header checkpoint every so often. Reports the
+// sustained throughput (including closing the file) and the latency of
+// individual writes, the worst of which decides how much ring buffer a
+// Recorder needs.
+//
+//   bench/sink [directory] [megabytes]
+//
+// Run it on the filesystem the recordings go to, with a size well past the
+// machine's dirty page limits, or the buffered sinks only measure memory.
+
+#include "bench.hpp"
+#include "sink.hpp"
+#include "wavwriter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// What the disk writer hands over at once: a block of float samples
+static const size_t WRITE_SIZE = (1 << 16) * sizeof(float);
+// A checkpoint every second of 16 channels of float at 48kHz
+static const size_t CHECKPOINT_BYTES = 16 * 4 * 48000;
+
+int main(int argc, char **argv) {
+  std::string directory = argc > 1 ? argv[1] : ".";
+  size_t megabytes = argc > 2 ? atoi(argv[2]) : 1024;
+  size_t total = megabytes << 20;
+  std::string filename = directory + "/sink-bench.wav";
+
+  std::vector<uint8_t> data(WRITE_SIZE);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = rand();
+  }
+
+  printf("%-14s %10s %12s %12s %12s\n", "sink", "MB/s", "median", "99%",
+         "worst");
+  const SinkType types[] = {STDIO_SINK, MMAP_SINK, DIRECT_SINK};
+  for (SinkType type : types) {
+    std::unique_ptr<Sink> sink = createSink(type);
+    if (not sink->open(filename.c_str())) {
+      printf("Couldn't open %s\n", filename.c_str());
+      return 1;
+    }
+    std::vector<double> latencies;
+    size_t next_checkpoint = CHECKPOINT_BYTES;
+    auto start = std::chrono::steady_clock::now();
+    writeheader(*sink, SampleFmt::FLOAT_32, 16, 0, 48000);
+    for (size_t done = 0; done < total; done += WRITE_SIZE) {
+      auto before = std::chrono::steady_clock::now();
+      sink->write(data.data(), WRITE_SIZE);
+      if (done >= next_checkpoint) {
+        checkpointwav(*sink, SampleFmt::FLOAT_32, 16, done / 64, 48000);
+        next_checkpoint += CHECKPOINT_BYTES;
+      }
+      auto after = std::chrono::steady_clock::now();
+      latencies.push_back(
+          std::chrono::duration<double, std::milli>(after - before).count());
+    }
+    finishwav(*sink, SampleFmt::FLOAT_32, 16, total / 64, 48000);
+    sink->close();
+    auto end = std::chrono::steady_clock::now();
+    remove(filename.c_str());
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-14s %10.0f %9.3f ms %9.3f ms %9.3f ms\n", toString(type),
+           megabytes / seconds, latencies[latencies.size() / 2],
+           latencies[latencies.size() * 99 / 100], latencies.back());
+  }
+  return 0;
+}
@@ -9,6 +9,11 @@ void init(rack::Plugin *p) {
 	p->version = TOSTRING(VERSION);
 	
 	p->addModel(modelPushButton);
+    p->addModel(modelPushButton4);
+    p->addModel(modelPushButton16);
     p->addModel(modelNoiseGenerator);
+    p->addModel(modelNoiseBank);
     p->addModel(modelRecorder);
+    p->addModel(modelMultiRecorder);
+    p->addModel(modelPlayer);
 }
@@ -7,5 +7,10 @@ using namespace rack;
 extern Plugin *plugin;
 
 extern Model *modelPushButton;
+extern Model *modelPushButton4;
+extern Model *modelPushButton16;
 extern Model *modelNoiseGenerator;
+extern Model *modelNoiseBank;
 extern Model *modelRecorder;
+extern Model *modelMultiRecorder;
+extern Model *modelPlayer;
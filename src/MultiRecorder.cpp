@@ -0,0 +1,85 @@
+#include "Recorder.hpp"
+
+// Records up to 16 tracks into one interleaved file, or into one file per
+// track. The number of tracks is set by the highest connected track input
+// when recording starts.
+struct MultiRecorder : RecorderBase {
+  enum ParamIds {
+    RECORD_BUTTON = 0,
+    NUM_PARAMS = 1,
+  };
+
+  enum OutputIds {
+    NUM_OUTPUTS = 0,
+  };
+
+  enum LightIds {
+    NUM_LIGHTS = 0,
+  };
+
+  enum InputIds {
+    TRACK_INPUT = 0,
+    GATE_INPUT = TRACK_INPUT + MAX_CHANNELS, // records while high
+    NUM_INPUTS = GATE_INPUT + 1,
+  };
+
+  MultiRecorder()
+      : RecorderBase(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS,
+                     MAX_CHANNELS) {}
+  void step() override;
+};
+
+void MultiRecorder::step() {
+  TIME_STEP(timing);
+  if (not isRecording()) {
+    num_channels = 1;
+    for (int i = 0; i < MAX_CHANNELS; i++) {
+      if (inputs[TRACK_INPUT + i].active) {
+        num_channels = i + 1;
+      }
+    }
+  }
+
+  float frame[MAX_CHANNELS];
+  for (int i = 0; i < MAX_CHANNELS; i++) {
+    frame[i] = inputs[TRACK_INPUT + i].value;
+  }
+  stepRecorder(recordRequest(params[RECORD_BUTTON], inputs[GATE_INPUT]),
+               frame);
+}
+
+struct MultiRecorderWidget : RecorderBaseWidget {
+  MultiRecorderWidget(MultiRecorder *module);
+};
+
+MultiRecorderWidget::MultiRecorderWidget(MultiRecorder *module)
+    : RecorderBaseWidget(module) {
+  setPanel(SVG::load(assetPlugin(plugin, "res/MultiRecorder.svg")));
+
+  // Mounting Screws
+  addChild(Widget::create<ScrewSilver>(Vec(15, 0)));
+  addChild(Widget::create<ScrewSilver>(Vec(45, 365)));
+
+  // Tracks 1-8 down the left column, 9-16 down the right
+  const float Y_DIST = 28;
+  for (int i = 0; i < MAX_CHANNELS; i++) {
+    Vec pos = Vec(i < 8 ? 10 : 42, 30 + Y_DIST * (i % 8));
+    addInput(Port::create<PJ301MPort>(pos, Port::INPUT, module,
+                                      MultiRecorder::TRACK_INPUT + i));
+  }
+
+  display = Widget::create<RecordingDisplay>(Vec(5, 264));
+  display->recorder = module;
+  addChild(display);
+  button = ParamWidget::create<RecordButton>(
+      Vec(41, 264), module, MultiRecorder::RECORD_BUTTON, 0.0f, 1.0f, 0.0f);
+  addParam(button);
+  gate_input = MultiRecorder::GATE_INPUT;
+  addInput(Port::create<PJ301MPort>(Vec(45, 299), Port::INPUT, module,
+                                    MultiRecorder::GATE_INPUT));
+  addLevels(Vec(5, 328), Vec(65, 30));
+}
+
+Model *modelMultiRecorder = Model::create<MultiRecorder, MultiRecorderWidget>(
+    "MicroTools", "Multitrack Recorder", "Multitrack Recorder",
+    RECORDING_TAG);
@@ -0,0 +1,270 @@
+#include "NoiseGenerator.hpp"
+#include "block.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_BANK_X86 1
+#include <xmmintrin.h>
+#endif
+
+// Independent noise sources in a bank. A multiple of 4, for the SIMD pass.
+#define NOISE_BANK_CHANNELS 16
+
+// Sixteen independent noise sources in one module. They share the knobs,
+// the noise type and the random number generator, and each has its own CV
+// inputs for period and volume (added to the knobs) and its own output.
+// The clocks of all sources are advanced together, four at a time, a block of
+// STEP_BLOCK frames at once.
+//
+// Poisson Triggers work as in the NoiseGenerator, with the period setting the
+// mean time between events, but the pulses are always POISSON_MIN_WIDTH long.
+struct NoiseBank : NoiseBase {
+  enum ParamIds {
+    PERIOD_KNOB = 0,
+    VOLUME_KNOB = 1,
+    PERIOD_MULTIPLIER = 2,
+    NUM_PARAMS = 3,
+  };
+
+  enum OutputIds {
+    NOISE_OUTPUT = 0,
+    NUM_OUTPUTS = NOISE_OUTPUT + NOISE_BANK_CHANNELS,
+  };
+
+  enum LightIds {
+    NUM_LIGHTS = 0,
+  };
+
+  enum InputIds {
+    PERIOD_CV = 0,
+    VOLUME_CV = PERIOD_CV + NOISE_BANK_CHANNELS,
+    NUM_INPUTS = VOLUME_CV + NOISE_BANK_CHANNELS,
+  };
+
+  NoiseBank() : NoiseBase(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS) {
+    std::fill(next, next + NOISE_BANK_CHANNELS, 1.0f);
+  }
+  void step() override;
+
+private:
+  // Per source. The clock state is kept in arrays for the SIMD pass.
+  alignas(16) float length[NOISE_BANK_CHANNELS] = {}; // see clockLength()
+  alignas(16) float phase[NOISE_BANK_CHANNELS] = {};
+  alignas(16) float delta[NOISE_BANK_CHANNELS] = {}; // of phase, per frame
+  // Where the phase ends the period: 1, or a Poisson event (see NoiseVoice)
+  alignas(16) float next[NOISE_BANK_CHANNELS];
+  float volume[NOISE_BANK_CHANNELS] = {}; // knob and CV, for the block
+  float held[NOISE_BANK_CHANNELS] = {};
+  float pulse[NOISE_BANK_CHANNELS] = {}; // frames left, for Poisson Triggers
+  bool poisson = false;                  // what `next` is for
+  NoiseSource sources[NOISE_BANK_CHANNELS];
+  MinBlep bleps[NOISE_BANK_CHANNELS];
+  OutputBlock<NOISE_BANK_CHANNELS> block;
+
+  void resetNoise() override;
+  // Reads the controls and makes the next block
+  void processBlock();
+  // The next block of TYPE noise into `out`, with no switch on the type in
+  // the loop. `width` is the Poisson Trigger pulse width, in frames.
+  template <NoiseType TYPE> void run(float *out, float width);
+
+  // Sets every clock's `delta` for frames `frames` long at
+  // PERIOD_REFERENCE_RATE, from `length`.
+  void setDeltas(float frames);
+  // Advances every clock by a frame. Returns a mask of the sources whose
+  // period ended.
+  int advance();
+};
+
+void NoiseBank::resetNoise() {
+  for (int c = 0; c < NOISE_BANK_CHANNELS; c++) {
+    phase[c] = 0.0f;
+    next[c] = poisson ? exponential(random) : 1.0f;
+    held[c] = 0.0f;
+    pulse[c] = 0.0f;
+    sources[c].reset();
+    bleps[c].reset();
+  }
+}
+
+void NoiseBank::setDeltas(float frames) {
+#ifdef NOISE_BANK_X86
+  const __m128 f = _mm_set1_ps(frames);
+  for (int c = 0; c < NOISE_BANK_CHANNELS; c += 4) {
+    _mm_store_ps(&delta[c], _mm_div_ps(f, _mm_load_ps(&length[c])));
+  }
+#else
+  for (int c = 0; c < NOISE_BANK_CHANNELS; c++) {
+    delta[c] = frames / length[c];
+  }
+#endif
+}
+
+int NoiseBank::advance() {
+  int ended = 0;
+#ifdef NOISE_BANK_X86
+  for (int c = 0; c < NOISE_BANK_CHANNELS; c += 4) {
+    __m128 p = _mm_add_ps(_mm_load_ps(&phase[c]), _mm_load_ps(&delta[c]));
+    _mm_store_ps(&phase[c], p);
+    ended |= _mm_movemask_ps(_mm_cmpge_ps(p, _mm_load_ps(&next[c]))) << c;
+  }
+#else
+  for (int c = 0; c < NOISE_BANK_CHANNELS; c++) {
+    phase[c] += delta[c];
+    if (phase[c] >= next[c]) {
+      ended |= 1 << c;
+    }
+  }
+#endif
+  return ended;
+}
+
+void NoiseBank::step() {
+  TIME_STEP(timing);
+  if (block.due()) {
+    processBlock();
+  }
+  const float *frame = block.next();
+  for (int c = 0; c < NOISE_BANK_CHANNELS; c++) {
+    outputs[NOISE_OUTPUT + c].value = frame[c];
+  }
+}
+
+void NoiseBank::processBlock() {
+  applyCommands();
+  if (poisson != (noiseType == NoiseType::POISSON_TRIGGER)) {
+    poisson = not poisson;
+    for (int c = 0; c < NOISE_BANK_CHANNELS; c++) {
+      phase[c] = 0.0f;
+      next[c] = poisson ? exponential(random) : 1.0f;
+      held[c] = 0.0f;
+    }
+  }
+
+  float period_knob = params[PERIOD_KNOB].value;
+  bool multiplied = params[PERIOD_MULTIPLIER].value;
+  float volume_knob = params[VOLUME_KNOB].value;
+  for (int c = 0; c < NOISE_BANK_CHANNELS; c++) {
+    length[c] =
+        clockLength(period_knob + inputs[PERIOD_CV + c].value, multiplied);
+    volume[c] = volume_knob + inputs[VOLUME_CV + c].value;
+  }
+  setDeltas(engineGetSampleTime() * PERIOD_REFERENCE_RATE);
+
+  float *out = block.fill();
+  float width = POISSON_MIN_WIDTH * engineGetSampleRate();
+  switch (noiseType) {
+  case NoiseType::WHITE_NOISE:
+  default:
+    run<NoiseType::WHITE_NOISE>(out, width);
+    break;
+  case NoiseType::BROWNIAN:
+    run<NoiseType::BROWNIAN>(out, width);
+    break;
+  case NoiseType::TRIGGER:
+    run<NoiseType::TRIGGER>(out, width);
+    break;
+  case NoiseType::PINK_NOISE:
+    run<NoiseType::PINK_NOISE>(out, width);
+    break;
+  case NoiseType::BLUE_NOISE:
+    run<NoiseType::BLUE_NOISE>(out, width);
+    break;
+  case NoiseType::VIOLET_NOISE:
+    run<NoiseType::VIOLET_NOISE>(out, width);
+    break;
+  case NoiseType::POISSON_TRIGGER:
+    run<NoiseType::POISSON_TRIGGER>(out, width);
+    break;
+  }
+}
+
+template <NoiseType TYPE> void NoiseBank::run(float *out, float width) {
+  for (int f = 0; f < STEP_BLOCK; f++) {
+    float *frame = &out[f * NOISE_BANK_CHANNELS];
+    if (TYPE == NoiseType::POISSON_TRIGGER) {
+      for (int ended = advance(); ended; ended &= ended - 1) {
+        int c = __builtin_ctz(ended);
+        pulse[c] =
+            poissonEvent(random, phase[c], next[c], delta[c], width, pulse[c]);
+      }
+      for (int c = 0; c < NOISE_BANK_CHANNELS; c++) {
+        frame[c] = pulse[c] > 0.0f ? volume[c] : 0.0f;
+        pulse[c] = std::max(pulse[c] - 1.0f, 0.0f);
+      }
+      continue;
+    }
+
+    for (int ended = advance(); ended; ended &= ended - 1) {
+      int c = __builtin_ctz(ended);
+      // Periods shorter than a frame just skip samples
+      phase[c] -= floorf(phase[c]);
+      float previous = held[c];
+      held[c] = sources[c].next<TYPE>(random, held[c], volume[c]);
+      // As in the NoiseGenerator, triggers keep their hard edges
+      if (TYPE != NoiseType::TRIGGER) {
+        bleps[c].jump(-phase[c] / delta[c], held[c] - previous);
+      }
+    }
+    for (int c = 0; c < NOISE_BANK_CHANNELS; c++) {
+      frame[c] = held[c] + bleps[c].shift();
+    }
+  }
+}
+
+struct NoiseBankWidget : ModuleWidget {
+  NoiseTypeDisplay *display;
+  NoiseBank *noiseBank;
+  NoiseBankWidget(NoiseBank *module);
+
+  void step() override {
+    ModuleWidget::step();
+    noiseBank->sendPending();
+    display->setDisplay(noiseBank->getNoiseType());
+  }
+
+#ifdef MICROTOOLS_PROFILE
+  void appendContextMenu(Menu *menu) override {
+    appendTimingMenu(menu, noiseBank->timing, model->slug);
+  }
+#endif
+};
+
+NoiseBankWidget::NoiseBankWidget(NoiseBank *module) : ModuleWidget(module) {
+  setPanel(SVG::load(assetPlugin(plugin, "res/NoiseBank.svg")));
+  noiseBank = module;
+  // Mounting Screws
+  addChild(Widget::create<ScrewSilver>(Vec(15, 0)));
+  addChild(Widget::create<ScrewSilver>(Vec(150, 0)));
+  addChild(Widget::create<ScrewSilver>(Vec(15, 365)));
+  addChild(Widget::create<ScrewSilver>(Vec(150, 365)));
+
+  addParam(ParamWidget::create<RoundBlackKnob>(Vec(10, 30), module,
+                                               NoiseBank::VOLUME_KNOB, 0.0f,
+                                               12.0f, 1.0f));
+  addParam(ParamWidget::create<RoundBlackKnob>(Vec(55, 30), module,
+                                               NoiseBank::PERIOD_KNOB, 0.0f,
+                                               10.0f, 0.0f));
+  addParam(ParamWidget::create<CKSS>(Vec(102, 35), module,
+                                     NoiseBank::PERIOD_MULTIPLIER, 0.0f, 1.0f,
+                                     0.0f));
+  display = Widget::create<NoiseTypeDisplay>(Vec(130, 38));
+  display->noiseDest = module;
+  addChild(display);
+
+  // Sources 1-8 down the left half, 9-16 down the right. Each row is period
+  // CV, volume CV and output.
+  const float Y_DIST = 32;
+  for (int i = 0; i < NOISE_BANK_CHANNELS; i++) {
+    float x = i < 8 ? 8 : 98;
+    float y = 95 + Y_DIST * (i % 8);
+    addInput(Port::create<PJ301MPort>(Vec(x, y), Port::INPUT, module,
+                                      NoiseBank::PERIOD_CV + i));
+    addInput(Port::create<PJ301MPort>(Vec(x + 26, y), Port::INPUT, module,
+                                      NoiseBank::VOLUME_CV + i));
+    addOutput(Port::create<PJ301MPort>(Vec(x + 52, y), Port::OUTPUT, module,
+                                       NoiseBank::NOISE_OUTPUT + i));
+  }
+}
+
+Model *modelNoiseBank = Model::create<NoiseBank, NoiseBankWidget>(
+    "MicroTools", "Noise Bank", "Noise Bank", NOISE_TAG);
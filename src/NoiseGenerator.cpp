@@ -1,30 +1,14 @@
-#include "MicroTools.hpp"
+#include "NoiseGenerator.hpp"
+#include "block.hpp"
 #include "dsp/digital.hpp"
-#include <map>
-#include <string>
 
-enum NoiseType {
-  WHITE_NOISE,
-  BROWNIAN,
-  TRIGGER,
-};
-
-const std::map<NoiseType, std::pair<const char *, const char *>> noiseToStr = {
-    {WHITE_NOISE, {"White Noise", "WHITE"}},
-    {BROWNIAN, {"Brownian Noise", "BROWN"}},
-    {TRIGGER, {"Random Trigger", "TRIGG"}},
-};
-
-const std::pair<const char *, const char *> toString(NoiseType format) {
-  return noiseToStr.at(format);
-}
-
-struct NoiseGenerator : Module {
+struct NoiseGenerator : NoiseBase {
   enum ParamIds {
     PERIOD_KNOB = 0,
     VOLUME_KNOB = 1,
     PERIOD_MULTIPLIER = 2,
-    NUM_PARAMS = 3,
+    PULSE_WIDTH = 3,
+    NUM_PARAMS = 4,
   };
 
   enum OutputIds {
@@ -41,111 +25,47 @@ struct NoiseGenerator : Module {
     NUM_INPUTS = 2,
   };
 
-  NoiseGenerator() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS) {}
+  NoiseGenerator()
+      : NoiseBase(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS) {}
   void step() override;
-  int timer = 0;
-  float last_out = 0.0f;
-  NoiseType noiseType = NoiseType::WHITE_NOISE;
-
-  json_t *toJson() override {
-    json_t *rootJ = json_object();
-    json_t *jsonNoiseType = json_integer(noiseType);
-    json_object_set_new(rootJ, "noiseType", jsonNoiseType);
-    return rootJ;
-  }
 
-  void fromJson(json_t *rootJ) override {
-    printf("fromJson\n");
-    json_t *noiseJ = json_object_get(rootJ, "noiseType");
-    noiseType = static_cast<NoiseType>(json_integer_value(noiseJ));
-  }
+private:
+  NoiseVoice voice; // see bench/render for the same DSP offline
+  OutputBlock<1> block;
+
+  void resetNoise() override { voice.reset(); }
+  // Reads the controls and makes the next block
+  void processBlock();
 };
 
 void NoiseGenerator::step() {
-  // The knob and CV inputs are from 0V to 10V. (note that negative CV inputs
-  // will still work) We then multiply the knob and CV inputs by 10V to obtain a
-  // nicer distribution of values. This way, clock length can range from 1 to
-  // 1000 instead of just 1 to 10. PERIOD_MULTIPLIER will increase the range
-  // from 1 to 100,000
-  float f_clock_length =
-      (params[PERIOD_KNOB].value + inputs[PERIOD_CV].value) * 10.0f;
-  f_clock_length *= params[PERIOD_MULTIPLIER].value ? 100.0f : 1.0f;
-
-  int clock_length = max(static_cast<int>(f_clock_length), 1);
-
-  float volume = params[VOLUME_KNOB].value + inputs[VOLUME_CV].value;
-  // Every clock_length frames, set the current output to a new sample.
-  // TODO: don't use the set frame rate, actually do this via time.
-  if (timer % clock_length == 0) {
-    switch (noiseType) {
-    case NoiseType::WHITE_NOISE: {
-      float sample = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-      last_out = sample * volume;
-      break;
-    }
-    case NoiseType::BROWNIAN: {
-      float sample = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-      sample = 2 * (sample - 0.5);
-      last_out += sample * volume / 10;
-
-      last_out = min(max(0.0f, last_out), volume);
-      break;
-    }
-    case NoiseType::TRIGGER: {
-      float sample = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
-      last_out = sample > volume / 10.0f ? 1.0f : 0.0f;
-      break;
-    }
-    }
-    // printf("%s\n", toString(noiseType).first);
+  TIME_STEP(timing);
+  if (block.due()) {
+    processBlock();
   }
-  timer = (timer + 1) % clock_length;
-
-  outputs[0].value = last_out;
+  outputs[0].value = *block.next();
 }
 
-struct ModeItem : MenuItem {
-  NoiseType noiseType;
-  NoiseType *noiseDest;
-  ModeItem(NoiseType noiseType, NoiseType *noiseDest) {
-    this->noiseType = noiseType;
-    this->text = toString(noiseType).first;
-    this->noiseDest = noiseDest;
-    this->rightText = CHECKMARK(noiseType == *noiseDest);
-  }
+void NoiseGenerator::processBlock() {
+  applyCommands();
 
-  // on click, set the NoiseGenerator to use the selected format.
-  void onAction(EventAction &e) override { *noiseDest = this->noiseType; }
-};
-
-struct NoiseTypeDisplay : LedDisplay {
-  char msg[8] = {0};
-
-  LedDisplayChoice *displayChoice = nullptr;
-  NoiseType *noiseDest; // Where the NoiseType value should get written to upon
-                        // clicking a menu item
-
-  NoiseTypeDisplay() {
-    box.size = Vec(35, 22);
-    Vec pos = Vec(0, 0);
-    displayChoice = Widget::create<LedDisplayChoice>(pos);
-    displayChoice->textOffset = Vec(3, 14);
-    displayChoice->box.size = Vec(35, 22);
-    addChild(displayChoice);
-  }
-
-  void setDisplay(NoiseType noiseType) {
-    displayChoice->text = toString(noiseType).second;
-  }
-
-  void onMouseDown(EventMouseDown &e) override {
-    Menu *menu = gScene->createMenu();
-    menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Noise Type"));
-    menu->addChild(new ModeItem(NoiseType::WHITE_NOISE, noiseDest));
-    menu->addChild(new ModeItem(NoiseType::BROWNIAN, noiseDest));
-    menu->addChild(new ModeItem(NoiseType::TRIGGER, noiseDest));
+  float f_clock_length =
+      clockLength(params[PERIOD_KNOB].value + inputs[PERIOD_CV].value,
+                  params[PERIOD_MULTIPLIER].value);
+  float volume = params[VOLUME_KNOB].value + inputs[VOLUME_CV].value;
+  // Every period, set the current output to a new sample.
+  float delta = clockDelta(engineGetSampleTime(), f_clock_length);
+  // Poisson Trigger pulses, from POISSON_MIN_WIDTH to POISSON_MAX_WIDTH
+  float width = 0.0f;
+  if (noiseType == NoiseType::POISSON_TRIGGER) {
+    width = POISSON_MIN_WIDTH *
+            powf(POISSON_MAX_WIDTH / POISSON_MIN_WIDTH,
+                 params[PULSE_WIDTH].value) *
+            engineGetSampleRate();
   }
-};
+  voice.process(random, noiseType, delta, volume, width, block.fill(),
+                STEP_BLOCK);
+}
 
 struct NoiseGeneratorWidget : ModuleWidget {
   NoiseTypeDisplay *display;
@@ -154,8 +74,15 @@ struct NoiseGeneratorWidget : ModuleWidget {
 
   void step() override {
     ModuleWidget::step();
-    display->setDisplay(noiseGenerator->noiseType);
+    noiseGenerator->sendPending();
+    display->setDisplay(noiseGenerator->getNoiseType());
+  }
+
+#ifdef MICROTOOLS_PROFILE
+  void appendContextMenu(Menu *menu) override {
+    appendTimingMenu(menu, noiseGenerator->timing, model->slug);
   }
+#endif
 };
 
 NoiseGeneratorWidget::NoiseGeneratorWidget(NoiseGenerator *module)
@@ -187,9 +114,12 @@ NoiseGeneratorWidget::NoiseGeneratorWidget(NoiseGenerator *module)
   addParam(ParamWidget::create<CKSS>(Vec(30, 160), module,
                                      NoiseGenerator::PERIOD_MULTIPLIER, 0.0f,
                                      1.0f, 0.0f));
+  addParam(ParamWidget::create<Trimpot>(Vec(CV_X, 163), module,
+                                        NoiseGenerator::PULSE_WIDTH, 0.0f,
+                                        1.0f, 0.0f));
   // Noise Type Display
   display = Widget::create<NoiseTypeDisplay>(Vec(5, 260));
-  display->noiseDest = &module->noiseType;
+  display->noiseDest = module;
   addChild(display);
 
   // Output
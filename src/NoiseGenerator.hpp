@@ -0,0 +1,186 @@
+#pragma once
+
+#include "MicroTools.hpp"
+#include "TimingMenu.hpp"
+#include "commands.hpp"
+#include "noise.hpp"
+#include "random.hpp"
+#include <map>
+#include <string>
+
+const std::map<NoiseType, std::pair<const char *, const char *>> noiseToStr = {
+    {WHITE_NOISE, {"White Noise", "WHITE"}},
+    {BROWNIAN, {"Brownian Noise", "BROWN"}},
+    {TRIGGER, {"Random Trigger", "TRIGG"}},
+    {PINK_NOISE, {"Pink Noise", "PINK"}},
+    {BLUE_NOISE, {"Blue Noise", "BLUE"}},
+    {VIOLET_NOISE, {"Violet Noise", "VIOLT"}},
+    {POISSON_TRIGGER, {"Poisson Trigger", "POISS"}},
+};
+
+inline const std::pair<const char *, const char *> toString(NoiseType format) {
+  return noiseToStr.at(format);
+}
+
+// Changes made from the UI thread
+struct NoiseCommand {
+  enum Type { SET_TYPE, SET_SEED } type;
+  NoiseType noise_type;
+  uint32_t seed;
+};
+
+// What the noise modules have in common: the noise type, set from the
+// display's menu, and the random number generator and its seed.
+struct NoiseBase : Module {
+  NoiseType noiseType = NoiseType::WHITE_NOISE; // audio thread
+#ifdef MICROTOOLS_PROFILE
+  StepTiming timing;
+#endif
+
+  // Every instance gets its own sequence
+  NoiseBase(int num_params, int num_inputs, int num_outputs, int num_lights)
+      : Module(num_params, num_inputs, num_outputs, num_lights),
+        requestedSeed(randomu32()) {
+    random.setSeed(requestedSeed);
+  }
+
+  // UI thread. Changes are picked up at the start of the next step().
+  NoiseType getNoiseType() const { return requestedType; }
+  void setNoiseType(NoiseType type) {
+    requestedType = type;
+    typePending = true;
+    sendPending();
+  }
+  // Restarts the noise from `seed`. From then on the output only depends on
+  // the seed, the inputs and the sample rate, so it is the same every time.
+  uint32_t getSeed() const { return requestedSeed; }
+  void setSeed(uint32_t seed) {
+    requestedSeed = seed;
+    seedPending = true;
+    sendPending();
+  }
+  // UI thread. Call from the widget's step(): sends again whatever didn't
+  // fit in the queue, so the audio thread catches up with the menu.
+  void sendPending() {
+    if (typePending) {
+      typePending =
+          not commands.send({NoiseCommand::SET_TYPE, requestedType, 0});
+    }
+    if (seedPending) {
+      seedPending = not commands.send(
+          {NoiseCommand::SET_SEED, NoiseType::WHITE_NOISE, requestedSeed});
+    }
+  }
+
+  json_t *toJson() override {
+    json_t *rootJ = json_object();
+    json_t *jsonNoiseType = json_integer(requestedType);
+    json_object_set_new(rootJ, "noiseType", jsonNoiseType);
+    json_object_set_new(rootJ, "seed", json_integer(requestedSeed));
+    return rootJ;
+  }
+
+  void fromJson(json_t *rootJ) override {
+    // Types out of range, from a damaged or hand-edited patch, keep the
+    // current one
+    json_int_t type = json_integer_value(json_object_get(rootJ, "noiseType"));
+    if (type >= NoiseType::WHITE_NOISE and
+        type <= NoiseType::POISSON_TRIGGER) {
+      setNoiseType(static_cast<NoiseType>(type));
+    }
+    // Patches from before seeds keep a random one
+    if (json_t *seedJ = json_object_get(rootJ, "seed")) {
+      setSeed(json_integer_value(seedJ));
+    }
+  }
+
+protected:
+  Random random;
+
+  // Call at the start of step()
+  void applyCommands() {
+    commands.apply([this](const NoiseCommand &command) {
+      switch (command.type) {
+      case NoiseCommand::SET_TYPE:
+        noiseType = command.noise_type;
+        break;
+      case NoiseCommand::SET_SEED:
+        random.setSeed(command.seed);
+        resetNoise();
+        break;
+      }
+    });
+  }
+  // Puts the DSP back in its initial state, after the seed changed
+  virtual void resetNoise() = 0;
+
+private:
+  NoiseType requestedType = NoiseType::WHITE_NOISE;
+  uint32_t requestedSeed;
+  // Set while a change hasn't made it into the queue yet
+  bool typePending = false;
+  bool seedPending = false;
+  CommandQueue<NoiseCommand> commands;
+};
+
+struct ModeItem : MenuItem {
+  NoiseType noiseType;
+  NoiseBase *noiseDest;
+  ModeItem(NoiseType noiseType, NoiseBase *noiseDest) {
+    this->noiseType = noiseType;
+    this->text = toString(noiseType).first;
+    this->noiseDest = noiseDest;
+    this->rightText = CHECKMARK(noiseType == noiseDest->getNoiseType());
+  }
+
+  // on click, set the NoiseGenerator to use the selected format.
+  void onAction(EventAction &e) override {
+    noiseDest->setNoiseType(this->noiseType);
+  }
+};
+
+struct NewSeedItem : MenuItem {
+  NoiseBase *noiseDest;
+  NewSeedItem(NoiseBase *noiseDest) {
+    this->text = "New seed";
+    this->noiseDest = noiseDest;
+  }
+
+  void onAction(EventAction &e) override { noiseDest->setSeed(randomu32()); }
+};
+
+struct NoiseTypeDisplay : LedDisplay {
+  char msg[8] = {0};
+
+  LedDisplayChoice *displayChoice = nullptr;
+  NoiseBase *noiseDest; // Where the NoiseType value should get sent to upon
+                        // clicking a menu item
+
+  NoiseTypeDisplay() {
+    box.size = Vec(35, 22);
+    Vec pos = Vec(0, 0);
+    displayChoice = Widget::create<LedDisplayChoice>(pos);
+    displayChoice->textOffset = Vec(3, 14);
+    displayChoice->box.size = Vec(35, 22);
+    addChild(displayChoice);
+  }
+
+  void setDisplay(NoiseType noiseType) {
+    displayChoice->text = toString(noiseType).second;
+  }
+
+  void onMouseDown(EventMouseDown &e) override {
+    Menu *menu = gScene->createMenu();
+    menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Noise Type"));
+    menu->addChild(new ModeItem(NoiseType::WHITE_NOISE, noiseDest));
+    menu->addChild(new ModeItem(NoiseType::BROWNIAN, noiseDest));
+    menu->addChild(new ModeItem(NoiseType::TRIGGER, noiseDest));
+    menu->addChild(new ModeItem(NoiseType::PINK_NOISE, noiseDest));
+    menu->addChild(new ModeItem(NoiseType::BLUE_NOISE, noiseDest));
+    menu->addChild(new ModeItem(NoiseType::VIOLET_NOISE, noiseDest));
+    menu->addChild(new ModeItem(NoiseType::POISSON_TRIGGER, noiseDest));
+    menu->addChild(construct<MenuLabel>(
+        &MenuLabel::text, "Seed " + std::to_string(noiseDest->getSeed())));
+    menu->addChild(new NewSeedItem(noiseDest));
+  }
+};
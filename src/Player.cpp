@@ -0,0 +1,268 @@
+#include "MicroTools.hpp"
+#include "TimingMenu.hpp"
+#include "diskreader.hpp"
+#include "osdialog.h"
+#include "snapshot.hpp"
+
+#include <algorithm>
+
+// Size of the ring between the disk reader and the audio thread, in samples.
+// This is about 2.5 seconds of stereo audio at 96kHz.
+#define PLAYER_RING_CAPACITY (1 << 19)
+
+// What the panel shows, published by the audio thread
+struct PlayerStatus {
+  bool playing = false;
+  uint64_t position = 0; // frames played since starting
+};
+
+// Plays back a WAV file (such as a take from the Recorder) from disk.
+// Long files are streamed, so they load instantly.
+struct Player : Module {
+  enum ParamIds {
+    PLAY_BUTTON = 0,
+    LOOP_SWITCH = 1,
+    NUM_PARAMS = 2,
+  };
+
+  enum InputIds {
+    NUM_INPUTS = 0,
+  };
+
+  // A mono file plays on both outputs
+  enum OutputIds {
+    LEFT_OUTPUT = 0,
+    RIGHT_OUTPUT = 1,
+    NUM_OUTPUTS = 2,
+  };
+
+  enum LightIds {
+    NUM_LIGHTS = 0,
+  };
+
+  DiskReader reader;
+#ifdef MICROTOOLS_PROFILE
+  StepTiming timing;
+#endif
+
+  Player()
+      : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS),
+        reader(PLAYER_RING_CAPACITY, 2) {}
+  void step() override;
+
+  // UI thread. The reference stays valid until the next call.
+  const PlayerStatus &getStatus() { return statuses.read(); }
+  float getSeconds(const PlayerStatus &status) {
+    uint64_t length = reader.length();
+    int rate = reader.sampleRate();
+    return rate ? (length ? status.position % length : 0) / float(rate) : 0;
+  }
+
+  json_t *toJson() override;
+  void fromJson(json_t *rootJ) override;
+
+private:
+  bool playing = false;
+  uint64_t position = 0; // frames played since starting
+  int status_frames = 0;
+  TripleBuffer<PlayerStatus> statuses;
+  bool last_button = false;
+  // The frames on either side of the playback position, which runs at the
+  // file's sample rate
+  float prev[2] = {}, next[2] = {};
+  float phase = 0;
+};
+
+void Player::step() {
+  TIME_STEP(timing);
+  if (++status_frames == STATUS_INTERVAL) {
+    status_frames = 0;
+    PlayerStatus &status = statuses.write();
+    status.playing = playing;
+    status.position = position;
+    statuses.publish();
+  }
+
+  bool button_on = params[PLAY_BUTTON].value;
+  if (button_on != last_button) {
+    last_button = button_on;
+    if (button_on) {
+      reader.play(0);
+      TIMING_EVENT(timing, PLAY_START);
+      position = 0;
+      phase = 0;
+      std::fill(prev, prev + 2, 0.0f);
+      std::fill(next, next + 2, 0.0f);
+    } else {
+      reader.stop();
+    }
+    playing = button_on;
+  }
+  reader.setLoop(params[LOOP_SWITCH].value);
+
+  if (not playing) {
+    outputs[LEFT_OUTPUT].value = 0.0f;
+    outputs[RIGHT_OUTPUT].value = 0.0f;
+    return;
+  }
+
+  int rate = reader.sampleRate();
+  phase += rate ? rate * engineGetSampleTime() : 1.0f;
+  while (phase >= 1.0f) {
+    phase -= 1.0f;
+    std::copy(next, next + 2, prev);
+    if (reader.read(next, 1) == 1) {
+      position++;
+    } else if (reader.atEnd()) {
+      playing = false;
+      break;
+    }
+    // Otherwise the reader is still catching up with play(), hold
+  }
+  outputs[LEFT_OUTPUT].value = crossfade(prev[0], next[0], phase);
+  outputs[RIGHT_OUTPUT].value = crossfade(prev[1], next[1], phase);
+}
+
+json_t *Player::toJson() {
+  json_t *rootJ = json_object();
+  json_object_set_new(rootJ, "file", json_string(reader.filename().c_str()));
+  return rootJ;
+}
+
+void Player::fromJson(json_t *rootJ) {
+  json_t *fileJ = json_object_get(rootJ, "file");
+  if (fileJ and json_string_value(fileJ)[0]) {
+    reader.load(json_string_value(fileJ));
+  }
+}
+
+struct PlayButton : SVGSwitch, ToggleSwitch {
+  PlayButton() {
+    addFrame(SVG::load(assetPlugin(plugin, "res/DarkButton.svg")));
+    addFrame(SVG::load(assetPlugin(plugin, "res/LightButton.svg")));
+  }
+};
+
+struct LoadItem : MenuItem {
+  Player *player;
+  LoadItem(Player *player) {
+    this->text = "Load WAV file...";
+    this->player = player;
+  }
+
+  void onAction(EventAction &e) override {
+    osdialog_filters *filters = osdialog_filters_parse("WAV:wav");
+    char *path = osdialog_file(OSDIALOG_OPEN, nullptr, nullptr, filters);
+    osdialog_filters_free(filters);
+    if (path) {
+      player->reader.load(path);
+      free(path);
+    }
+  }
+};
+
+struct PlayerDisplay : LedDisplay {
+  char msg[8] = {0};
+
+  LedDisplayChoice *timerText = nullptr;
+  LedDisplaySeparator *separator = nullptr;
+  LedDisplayChoice *fileChoice = nullptr;
+  Player *player;
+
+  PlayerDisplay() {
+    box.size = Vec(35, 44);
+    Vec pos = Vec(0, 0);
+    timerText = Widget::create<LedDisplayChoice>(pos);
+    timerText->textOffset = Vec(3, 14);
+    timerText->box.size = Vec(35, 22);
+    pos = timerText->box.getBottomLeft();
+    setSeconds(0);
+    addChild(timerText);
+
+    separator = Widget::create<LedDisplaySeparator>(pos);
+    separator->box.size.x = box.size.x;
+    addChild(separator);
+
+    fileChoice = Widget::create<LedDisplayChoice>(pos);
+    fileChoice->textOffset = Vec(3, 14);
+    fileChoice->box.size = Vec(35, 22);
+    addChild(fileChoice);
+  }
+
+  void setSeconds(float seconds) {
+    sprintf(msg, "%02d:%02d", int(seconds) / 60 % 100, int(seconds) % 60);
+    timerText->text = msg;
+  }
+
+  void setLoaded(bool loaded) { fileChoice->text = loaded ? "WAV" : "LOAD"; }
+
+  void onMouseDown(EventMouseDown &e) override {
+    Menu *menu = gScene->createMenu();
+    std::string filename = player->reader.filename();
+    menu->addChild(construct<MenuLabel>(
+        &MenuLabel::text, filename.empty() ? "No file" : filename));
+    menu->addChild(new LoadItem(player));
+  }
+};
+
+struct PlayerWidget : ModuleWidget {
+  Player *player;
+  PlayerDisplay *display;
+  PlayButton *button;
+  bool last_playing = false;
+
+  PlayerWidget(Player *module);
+
+  void step() override;
+  void fromJson(json_t *rootJ) override;
+
+#ifdef MICROTOOLS_PROFILE
+  void appendContextMenu(Menu *menu) override {
+    appendTimingMenu(menu, player->timing, model->slug);
+  }
+#endif
+};
+
+PlayerWidget::PlayerWidget(Player *module) : ModuleWidget(module) {
+  setPanel(SVG::load(assetPlugin(plugin, "res/Player.svg")));
+  player = module;
+
+  // Mounting Screws
+  addChild(Widget::create<ScrewSilver>(Vec(15, 0)));
+  addChild(Widget::create<ScrewSilver>(Vec(15, 365)));
+
+  addOutput(Port::create<PJ301MPort>(Vec(10, 50), Port::OUTPUT, module,
+                                     Player::LEFT_OUTPUT));
+  addOutput(Port::create<PJ301MPort>(Vec(10, 90), Port::OUTPUT, module,
+                                     Player::RIGHT_OUTPUT));
+
+  display = Widget::create<PlayerDisplay>(Vec(5, 140));
+  display->player = module;
+  addChild(display);
+  button = ParamWidget::create<PlayButton>(Vec(7.5, 200), module,
+                                           Player::PLAY_BUTTON, 0.0f, 1.0f,
+                                           0.0f);
+  addParam(button);
+  addParam(ParamWidget::create<CKSS>(Vec(15, 260), module,
+                                     Player::LOOP_SWITCH, 0.0f, 1.0f, 0.0f));
+}
+
+void PlayerWidget::step() {
+  ModuleWidget::step();
+  const PlayerStatus &status = player->getStatus();
+  // Playback stops by itself at the end of the file, so let go of the button
+  if (status.playing != last_playing) {
+    last_playing = status.playing;
+    button->setValue(last_playing ? 1.0 : 0.0);
+  }
+  display->setSeconds(player->getSeconds(status));
+  display->setLoaded(player->reader.length() > 0);
+}
+
+void PlayerWidget::fromJson(json_t *rootJ) {
+  ModuleWidget::fromJson(rootJ);
+  button->setValue(0.0); // Make sure the Player isn't playing initially.
+}
+
+Model *modelPlayer = Model::create<Player, PlayerWidget>(
+    "MicroTools", "Player", "Player", SAMPLER_TAG);
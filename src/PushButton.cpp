@@ -1,45 +1,138 @@
 #include "MicroTools.hpp"
+#include "TimingMenu.hpp"
+#include "block.hpp"
+#include "commands.hpp"
 #include "dsp/digital.hpp"
+#include "pushbutton.hpp"
 
-#define NUM_CHANNELS 8
 // Voltages for the knobs
 #define DEFAULT_VOLTAGE 1.0f
 #define MAX_VOLTAGE 5.0f
 #define MIN_VOLTAGE -5.0f
+// How long the outputs take to reach a new value by default, in milliseconds
+#define DEFAULT_SLEW_MS 2.0f
+// Channels in a column of the panel
+#define COLUMN_CHANNELS 8
 
-struct PushButton : Module {
+// What the Push Buttons of every size have in common: the slew setting.
+struct PushButtonBase : Module {
+#ifdef MICROTOOLS_PROFILE
+    StepTiming timing;
+#endif
+
+    PushButtonBase(int num_params, int num_outputs, int num_lights)
+        : Module(num_params, 0, num_outputs, num_lights) {}
+
+    // UI thread. The ramp time in milliseconds, 0 to jump straight to the
+    // new value.
+    float getSlew() const { return requestedSlew; }
+    void setSlew(float ms) {
+        requestedSlew = ms;
+        slewPending = true;
+        sendPending();
+    }
+    // UI thread. Call from the widget's step(): sends the slew again if it
+    // didn't fit in the queue, so the audio thread catches up with the menu.
+    void sendPending() {
+        if (slewPending) {
+            slewPending = not commands.send(requestedSlew);
+        }
+    }
+
+    json_t *toJson() override {
+        json_t *rootJ = json_object();
+        json_object_set_new(rootJ, "slew", json_real(requestedSlew));
+        return rootJ;
+    }
+
+    void fromJson(json_t *rootJ) override {
+        // Patches from before the slew keep the default
+        if (json_t *slewJ = json_object_get(rootJ, "slew")) {
+            setSlew(json_number_value(slewJ));
+        }
+    }
+
+protected:
+    float slew = DEFAULT_SLEW_MS; // audio thread
+
+    // Call before reading the controls
+    void applyCommands() {
+        commands.apply([this](float ms) { slew = ms; });
+    }
+
+private:
+    float requestedSlew = DEFAULT_SLEW_MS;
+    bool slewPending = false; // set while it hasn't made it into the queue
+    CommandQueue<float> commands;
+};
+
+// CHANNELS buttons, each with a knob for the voltage it sends while held,
+// and an output. Changes ramp over the slew time, so muting audio doesn't
+// click; the DSP is in PushButtonCore. The lights are set by the widget.
+template <int CHANNELS>
+struct PushButton : PushButtonBase {
     enum ParamIds {
         LIGHT_PARAM = 0,
-        KNOB_PARAM = LIGHT_PARAM + NUM_CHANNELS,
-        NUM_PARAMS = NUM_CHANNELS * 2,
+        KNOB_PARAM = LIGHT_PARAM + CHANNELS,
+        NUM_PARAMS = CHANNELS * 2,
     };
     enum OutputIds {
-        NUM_OUTPUTS = NUM_CHANNELS
+        NUM_OUTPUTS = CHANNELS
     };
     enum LightIds {
-        NUM_LIGHTS = NUM_CHANNELS
+        NUM_LIGHTS = CHANNELS
     };
 
-    bool state[NUM_CHANNELS]; // tracks state of mute buttons
-    float knob[NUM_CHANNELS]; // tracks value of knobs
-
-    PushButton() : Module(NUM_PARAMS, 0, NUM_OUTPUTS, NUM_LIGHTS) {}
+    PushButton() : PushButtonBase(NUM_PARAMS, NUM_OUTPUTS, NUM_LIGHTS) {}
     void step() override;
+
+private:
+    PushButtonCore<CHANNELS> core; // see bench/modules for it offline
+    OutputBlock<CHANNELS> block;
+    bool ramping = false; // whether `block` has anything new
+
+    // Reads the controls and makes the next block
+    void processBlock();
 };
 
-void PushButton::step() {
-    for (int i = 0; i < NUM_CHANNELS; i++) {
-        float out = 0.0f;
-        state[i] = params[i + LIGHT_PARAM].value > 0 ? true : false;
-        knob[i] = params[i + KNOB_PARAM].value;
-        if (state[i]) {
-            out = knob[i];
+template <int CHANNELS>
+void PushButton<CHANNELS>::step() {
+    TIME_STEP(timing);
+    if (block.due()) {
+        processBlock();
+    }
+    const float *frame = block.next();
+    if (ramping) {
+        for (int i = 0; i < CHANNELS; i++) {
+            outputs[i].value = frame[i];
         }
-        outputs[i].value = out;
-        lights[i].setBrightness(state[i] ? 0.9f : 0.0f);
     }
 }
 
+template <int CHANNELS>
+void PushButton<CHANNELS>::processBlock() {
+    applyCommands();
+    float frames = slew * 0.001f / engineGetSampleTime();
+    for (int i = 0; i < CHANNELS; i++) {
+        bool state = params[i + LIGHT_PARAM].value > 0;
+        core.set(i, state ? params[i + KNOB_PARAM].value : 0.0f, frames);
+    }
+    ramping = core.process(block.fill(), STEP_BLOCK);
+}
+
+struct SlewItem : MenuItem {
+    PushButtonBase *pushButton;
+    float ms;
+    SlewItem(PushButtonBase *pushButton, float ms) {
+        this->pushButton = pushButton;
+        this->ms = ms;
+        this->text = ms > 0 ? stringf("%g ms", ms) : "Off";
+        this->rightText = CHECKMARK(ms == pushButton->getSlew());
+    }
+
+    void onAction(EventAction &e) override { pushButton->setSlew(ms); }
+};
+
 template <typename BASE>
 struct TriggerLight : BASE {
     TriggerLight() {
@@ -47,31 +140,67 @@ struct TriggerLight : BASE {
     }
 };
 
+// Lays the channels out in columns of COLUMN_CHANNELS, each as wide as the
+// 8 channel panel.
+template <int CHANNELS>
 struct PushButtonWidget : ModuleWidget {
-    PushButtonWidget(PushButton *module);
+    typedef PushButton<CHANNELS> TModule;
+    TModule *pushButton;
+    PushButtonWidget(TModule *module);
+
+    // The lights follow the buttons at the UI's frame rate, rather than
+    // being set by the audio thread every frame
+    void step() override {
+        pushButton->sendPending();
+        for (int i = 0; i < CHANNELS; i++) {
+            bool state = pushButton->params[TModule::LIGHT_PARAM + i].value > 0;
+            pushButton->lights[i].setBrightness(state ? 0.9f : 0.0f);
+        }
+        ModuleWidget::step();
+    }
+
+    void appendContextMenu(Menu *menu) override {
+        menu->addChild(construct<MenuLabel>());
+        menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Slew"));
+        for (float ms : {0.0f, 1.0f, 2.0f, 5.0f, 10.0f, 20.0f}) {
+            menu->addChild(new SlewItem(pushButton, ms));
+        }
+#ifdef MICROTOOLS_PROFILE
+        appendTimingMenu(menu, pushButton->timing, model->slug);
+#endif
+    }
 };
 
-PushButtonWidget::PushButtonWidget(PushButton *module) : ModuleWidget(module) {
-    setPanel(SVG::load(assetPlugin(plugin, "res/PushButton.svg")));
+template <int CHANNELS>
+PushButtonWidget<CHANNELS>::PushButtonWidget(TModule *module) : ModuleWidget(module) {
+    // The 8 channel panel keeps its original name
+    std::string panel = CHANNELS == 8 ? "res/PushButton.svg" : stringf("res/PushButton%d.svg", CHANNELS);
+    setPanel(SVG::load(assetPlugin(plugin, panel)));
+    pushButton = module;
 
     addChild(Widget::create<ScrewSilver>(Vec(15, 0)));
     addChild(Widget::create<ScrewSilver>(Vec(box.size.x - 30, 0)));
     addChild(Widget::create<ScrewSilver>(Vec(15, 365)));
     addChild(Widget::create<ScrewSilver>(Vec(box.size.x - 30, 365)));
 
-    for (int i = 0; i < NUM_CHANNELS; i++) {
+    for (int i = 0; i < CHANNELS; i++) {
         // Handles on click stuff
+        const float X_DIST = 120;
         const float Y_DIST = 38.5;
         const float KNOB_HEIGHT = 14.5;
         const float BEZEL_HEIGHT = 11;
         const float LIGHT_HEIGHT = 9;
         const float PORT_HEIGHT = 12.5;
-        addParam(ParamWidget::create<RoundBlackKnob>(Vec(9.507, 64 - KNOB_HEIGHT + Y_DIST * i), module, PushButton::KNOB_PARAM + i, MIN_VOLTAGE, MAX_VOLTAGE, DEFAULT_VOLTAGE));
-        addParam(ParamWidget::create<LEDBezel>(Vec(50, 64 - BEZEL_HEIGHT + Y_DIST * i), module, PushButton::LIGHT_PARAM + i, 0.0f, 1.0f, 0.0f));
-        addChild(ModuleLightWidget::create<TriggerLight<GreenLight>>(Vec(52, 64 - LIGHT_HEIGHT + Y_DIST * i), module, i));
-        addOutput(Port::create<PJ301MPort>(Vec(84, 64 - PORT_HEIGHT + Y_DIST * i), Port::OUTPUT, module, i));
+        float x = X_DIST * (i / COLUMN_CHANNELS);
+        float y = 64 + Y_DIST * (i % COLUMN_CHANNELS);
+        addParam(ParamWidget::create<RoundBlackKnob>(Vec(x + 9.507, y - KNOB_HEIGHT), module, TModule::KNOB_PARAM + i, MIN_VOLTAGE, MAX_VOLTAGE, DEFAULT_VOLTAGE));
+        addParam(ParamWidget::create<LEDBezel>(Vec(x + 50, y - BEZEL_HEIGHT), module, TModule::LIGHT_PARAM + i, 0.0f, 1.0f, 0.0f));
+        addChild(ModuleLightWidget::create<TriggerLight<GreenLight>>(Vec(x + 52, y - LIGHT_HEIGHT), module, i));
+        addOutput(Port::create<PJ301MPort>(Vec(x + 84, y - PORT_HEIGHT), Port::OUTPUT, module, i));
     }
 }
 
 
-Model *modelPushButton = Model::create<PushButton, PushButtonWidget>("MicroTools", "Push Button", "Push Button", UTILITY_TAG);
+Model *modelPushButton = Model::create<PushButton<8>, PushButtonWidget<8>>("MicroTools", "Push Button", "Push Button", UTILITY_TAG);
+Model *modelPushButton4 = Model::create<PushButton<4>, PushButtonWidget<4>>("MicroTools", "Push Button 4", "Push Button 4", UTILITY_TAG);
+Model *modelPushButton16 = Model::create<PushButton<16>, PushButtonWidget<16>>("MicroTools", "Push Button 16", "Push Button 16", UTILITY_TAG);
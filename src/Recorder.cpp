@@ -1,53 +1,130 @@
-#include "MicroTools.hpp"
+#include "Recorder.hpp"
 #include "dsp/digital.hpp"
-#include "wavwriter.hpp"
 
-#include <iostream>
-#include <vector>
+// Finds the first member of `link` in engine order. Only called when
+// membership changes, so the scan over every module is fine.
+void RecorderBase::findClock(RecordLink &link) {
+  link.dirty = false;
+  link.clock = nullptr;
+  for (Module *module : gModules) {
+    RecorderBase *recorder = dynamic_cast<RecorderBase *>(module);
+    if (recorder and &recorder->link() == &link) {
+      link.clock = recorder;
+      return;
+    }
+  }
+}
+
+json_t *RecorderBase::toJson() {
+  const RecorderSettings &settings = getSettings();
+  json_t *rootJ = json_object();
+  json_object_set_new(rootJ, "format", json_integer(settings.format));
+  json_object_set_new(rootJ, "dither", json_boolean(settings.dither));
+  json_object_set_new(rootJ, "split", json_boolean(settings.split));
+  json_object_set_new(rootJ, "linkGroup", json_integer(settings.link_group));
+  json_object_set_new(rootJ, "preroll", json_real(preroll_seconds));
+  json_object_set_new(rootJ, "outputRate", json_integer(settings.output_rate));
+  json_object_set_new(rootJ, "resampleQuality",
+                      json_integer(settings.resample_quality));
+  json_object_set_new(rootJ, "sink", json_integer(settings.sink));
+  json_object_set_new(rootJ, "threshold", json_integer(settings.threshold_db));
+  json_object_set_new(rootJ, "silence", json_real(settings.silence_seconds));
+  json_object_set_new(rootJ, "waveform", json_boolean(show_waveform));
+  return rootJ;
+}
 
-std::vector<uint8_t> to_bytes(SampleFmt format, std::vector<float> buffer) {
-  std::vector<uint8_t> byte_buffer;
-  for (float x : buffer) {
-    // Note: Audio output from Eurorack devices is +-12V
-    if (format == SampleFmt::PCM_U8) {
-      // Range will be from 0 to 255
-      uint8_t sample = 127 * (x / 12 + 1);
-      byte_buffer.push_back(sample);
-    } else if (format == SampleFmt::PCM_S16) {
-      // Range will be from -32766 to 32766
-      int16_t sample = 32766 * (x / 12);
-      // Pretend the 16bit integer is actually just two 8 bit bytes
-      uint8_t const *casted = reinterpret_cast<uint8_t const *>(&sample);
-      byte_buffer.push_back(casted[0]);
-      byte_buffer.push_back(casted[1]);
-    } else if (format == SampleFmt::FLOAT_32) {
-      // Wav files are expecting floats between -1 and 1.
-      float sample = x / 12;
-      // Pretend the 32bit float is actually just four 8 bit bytes
-      uint8_t const *casted = reinterpret_cast<uint8_t const *>(&sample);
-      byte_buffer.push_back(casted[0]);
-      byte_buffer.push_back(casted[1]);
-      byte_buffer.push_back(casted[2]);
-      byte_buffer.push_back(casted[3]);
-    } else {
-      assert(not"an expected format");
+// Values out of range, from a damaged or hand-edited patch, keep the current
+// setting
+void RecorderBase::fromJson(json_t *rootJ) {
+  RecorderSettings settings = getSettings();
+  if (json_t *formatJ = json_object_get(rootJ, "format")) {
+    json_int_t format = json_integer_value(formatJ);
+    if (format >= SampleFmt::PCM_U8 and format <= SampleFmt::FLAC_16) {
+      settings.format = static_cast<SampleFmt>(format);
+    }
+  }
+  if (json_t *ditherJ = json_object_get(rootJ, "dither")) {
+    settings.dither = json_is_true(ditherJ);
+  }
+  if (json_t *splitJ = json_object_get(rootJ, "split")) {
+    settings.split = json_is_true(splitJ);
+  }
+  if (json_t *linkJ = json_object_get(rootJ, "linkGroup")) {
+    json_int_t group = json_integer_value(linkJ);
+    settings.link_group = group >= 0 and group < NUM_LINK_GROUPS ? group : -1;
+  }
+  if (json_t *prerollJ = json_object_get(rootJ, "preroll")) {
+    setPreroll(json_number_value(prerollJ));
+  }
+  if (json_t *rateJ = json_object_get(rootJ, "outputRate")) {
+    // 0 records at the engine's rate; any other has to be one libsamplerate
+    // can convert to from it
+    json_int_t rate = json_integer_value(rateJ);
+    bool valid =
+        rate > 0 and src_is_valid_ratio(double(rate) / engineGetSampleRate());
+    settings.output_rate = valid ? rate : 0;
+  }
+  if (json_t *qualityJ = json_object_get(rootJ, "resampleQuality")) {
+    json_int_t quality = json_integer_value(qualityJ);
+    if (quality >= SRC_SINC_BEST_QUALITY and quality <= SRC_LINEAR) {
+      settings.resample_quality = quality;
+    }
+  }
+  if (json_t *sinkJ = json_object_get(rootJ, "sink")) {
+    json_int_t sink = json_integer_value(sinkJ);
+    if (sink >= SinkType::STDIO_SINK and sink <= SinkType::DIRECT_SINK) {
+      settings.sink = static_cast<SinkType>(sink);
+    }
+  }
+  if (json_t *thresholdJ = json_object_get(rootJ, "threshold")) {
+    // Above full scale nothing would ever start a take, so that is off (0)
+    json_int_t threshold = json_integer_value(thresholdJ);
+    settings.threshold_db =
+        std::min<json_int_t>(std::max<json_int_t>(threshold, -200), 0);
+  }
+  if (json_t *silenceJ = json_object_get(rootJ, "silence")) {
+    // Anything else would split the take at every block
+    double silence = json_number_value(silenceJ);
+    if (std::isfinite(silence) and silence > 0) {
+      settings.silence_seconds = silence;
     }
   }
+  if (json_t *waveformJ = json_object_get(rootJ, "waveform")) {
+    show_waveform = json_is_true(waveformJ);
+  }
+  setSettings(settings);
+}
 
-  return byte_buffer;
+void RecorderBaseWidget::fromJson(json_t *rootJ) {
+  ModuleWidget::fromJson(rootJ);
+  button->setValue(0.0); // Make sure the Recorder isn't recording initially.
 }
 
-// Returns true if the filename exists
-bool file_exists(const std::string &name) {
-  if (FILE *file = fopen(name.c_str(), "r")) {
-    fclose(file);
-    return true;
-  } else {
-    return false;
+void RecorderBaseWidget::step() {
+  ModuleWidget::step();
+  const RecorderStatus &status = recorder->getStatus();
+  // A linked Recorder can be started by another one's button, and any
+  // Recorder by its gate, so show the state of the link on the button too.
+  // While a gate is patched clicks do nothing, so they are undone. While
+  // waiting for sound to auto-split, the button is on but the display doesn't
+  // count.
+  bool gated = recorder->inputs[gate_input].active;
+  if (status.armed != last_armed or
+      (gated and (button->value > 0) != status.armed)) {
+    last_armed = status.armed;
+    button->setValue(last_armed ? 1.0 : 0.0);
   }
+  display->recording = status.recording;
+  display->setSeconds(status.num_samples / engineGetSampleRate());
+  display->setDisplay(recorder->getSettings().format);
+  meter->levels = recorder->meter.levels();
+  recorder->maintainPreroll(status.num_channels);
+  recorder->sendPending();
+  meter->visible = not recorder->show_waveform;
+  waveform->visible = recorder->show_waveform;
 }
 
-struct Recorder : Module {
+struct Recorder : RecorderBase {
   enum ParamIds {
     RECORD_BUTTON = 0,
     MONO_STEREO = 1,
@@ -63,188 +140,42 @@ struct Recorder : Module {
     NUM_LIGHTS = 1,
   };
 
-  // 2 inputs, for left and right channels
+  // 2 inputs, for left and right channels, and a gate that records while
+  // high
   enum InputIds {
     LEFT_INPUT = 0,
     RIGHT_INPUT = 1,
-    NUM_INPUTS = 2,
+    GATE_INPUT = 2,
+    NUM_INPUTS = 3,
   };
 
-  size_t num_samples = 0;
-  std::vector<float> buffer; // keeps track of the currently written samples
-  bool recording = false;
-  SampleFmt format = SampleFmt::FLOAT_32;
-  int num_channels = 1;
-
-  Recorder() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS) {}
+  Recorder()
+      : RecorderBase(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS, 2) {}
   void step() override;
-
-  float getSeconds() { return num_samples / engineGetSampleRate(); }
 };
 
 void Recorder::step() {
-  bool button_on = params[Recorder::RECORD_BUTTON].value;
+  TIME_STEP(timing);
+  bool button_on = recordRequest(params[Recorder::RECORD_BUTTON],
+                                 inputs[Recorder::GATE_INPUT]);
   bool is_stereo = params[Recorder::MONO_STEREO].value;
 
-  if (not recording) {
+  if (not isRecording()) {
     num_channels = is_stereo ? 2 : 1;
   }
 
-  // Went from not recording state to recording state
-  if (not recording and button_on) {
-    printf("Recording %d channels %f, %s\n", num_channels,
-           engineGetSampleRate(), toString(format));
-    buffer.clear();
-    // Push an initial empty sample to make sure the file doesn't start silent
-    // (otherwise, some programs interpret the WAV as corrupt or completly
-    // empty).
-    buffer.push_back(0.1);
-    buffer.push_back(0.1);
-    num_samples = num_channels == 1 ? 2 : 1;
-  }
-
-  if (recording and not button_on) {
-    int i = 0;
-    std::string filename = "recording0.wav";
-
-    do {
-      i++;
-      filename = "recording" + std::to_string(i) + ".wav";
-    } while (file_exists(filename));
-
-    std::vector<uint8_t> byte_buffer = to_bytes(format, buffer);
-    writewav(&byte_buffer[0], format, num_channels, num_samples,
-             engineGetSampleRate(), filename.c_str());
-    printf("Wrote %s\n", filename.c_str());
-  }
-
-  if (recording) {
-    // Note: While this buffer always has floats, the actual conversion is done
-    // at write time
-    if (num_channels == 1) {
-      buffer.push_back(inputs[Recorder::LEFT_INPUT].value);
-    } else {
-      // When stereo, the samples are interleaved.
-      buffer.push_back(inputs[Recorder::LEFT_INPUT].value);
-      buffer.push_back(inputs[Recorder::RIGHT_INPUT].value);
-    }
-    num_samples += 1;
-  }
-
-  recording = button_on;
+  // When stereo, the samples are interleaved.
+  const float frame[2] = {inputs[Recorder::LEFT_INPUT].value,
+                          inputs[Recorder::RIGHT_INPUT].value};
+  stepRecorder(button_on, frame);
 }
 
-struct RecordButton : SVGSwitch, ToggleSwitch {
-  RecordButton() {
-    addFrame(SVG::load(assetPlugin(plugin, "res/DarkButton.svg")));
-    addFrame(SVG::load(assetPlugin(plugin, "res/LightButton.svg")));
-  }
-};
-
-struct FormatItem : MenuItem {
-  SampleFmt format;
-  Recorder *recorder;
-  FormatItem(SampleFmt format, Recorder *recorder) {
-    this->format = format;
-    this->text = toString(format);
-    this->recorder = recorder;
-    this->rightText = CHECKMARK(format == recorder->format);
-  }
-
-  // on click, set the Recorder to use the selected format.
-  void onAction(EventAction &e) override { recorder->format = this->format; }
-};
-
-struct RecordingDisplay : LedDisplay {
-  char msg[8] = {0};
-  bool recording = false;
-
-  LedDisplayChoice *timerText = nullptr;
-  LedDisplaySeparator *separator = nullptr;
-  LedDisplayChoice *formatChoice = nullptr;
-  Recorder *recorder;
-
-  RecordingDisplay() {
-    box.size = Vec(35, 44);
-    Vec pos = Vec(0, 0);
-    timerText = Widget::create<LedDisplayChoice>(pos);
-    timerText->textOffset = Vec(3, 14);
-    timerText->box.size = Vec(35, 22);
-    pos = timerText->box.getBottomLeft();
-    setSeconds(0);
-    addChild(timerText);
-
-    separator = Widget::create<LedDisplaySeparator>(pos);
-    separator->box.size.x = box.size.x;
-    addChild(separator);
-
-    formatChoice = Widget::create<LedDisplayChoice>(pos);
-    formatChoice->textOffset = Vec(3, 14);
-    formatChoice->box.size = Vec(35, 22);
-    pos = formatChoice->box.getBottomLeft();
-    addChild(formatChoice);
-  }
-
-  void setSeconds(float seconds) {
-    float frac_second = seconds - int(seconds);
-    if (seconds > 60 * 60) {
-      seconds /= 60;
-    }
-
-    int a = int(seconds) / 60, b = int(seconds) % 60;
-
-    // Blink the : every second
-    if (frac_second < 0.5 or not recording) {
-      sprintf(msg, "%02d:%02d", a, b);
-    } else {
-      sprintf(msg, "%02d %02d", a, b);
-    }
-
-    timerText->text = msg;
-  }
-
-  void setDisplay(SampleFmt format) {
-    switch (format) {
-    case SampleFmt::PCM_U8:
-      formatChoice->text = "8 USI";
-      break;
-    case SampleFmt::PCM_S16:
-      formatChoice->text = "16 SI";
-      break;
-    case SampleFmt::FLOAT_32:
-      formatChoice->text = "32 FL";
-      break;
-    default:
-      formatChoice->text = "ERROR";
-      break;
-    }
-  }
-
-  void onMouseDown(EventMouseDown &e) override {
-    Menu *menu = gScene->createMenu();
-    menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Format"));
-    if (recorder->recording) {
-      menu->addChild(MenuItem::create("Can't change formats while recording!"));
-    } else {
-      menu->addChild(new FormatItem(SampleFmt::PCM_U8, recorder));
-      menu->addChild(new FormatItem(SampleFmt::PCM_S16, recorder));
-      menu->addChild(new FormatItem(SampleFmt::FLOAT_32, recorder));
-    }
-  }
-};
-
-struct RecorderWidget : ModuleWidget {
-  Recorder *recorder;
-  RecordingDisplay *display;
-  RecordButton *button;
+struct RecorderWidget : RecorderBaseWidget {
   RecorderWidget(Recorder *module);
-  void step() override;
-  void fromJson(json_t *rootJ) override;
 };
 
-RecorderWidget::RecorderWidget(Recorder *module) : ModuleWidget(module) {
+RecorderWidget::RecorderWidget(Recorder *module) : RecorderBaseWidget(module) {
   setPanel(SVG::load(assetPlugin(plugin, "res/Recorder.svg")));
-  recorder = module;
 
   // Mounting Screws
   addChild(Widget::create<ScrewSilver>(Vec(15, 0)));
@@ -255,6 +186,8 @@ RecorderWidget::RecorderWidget(Recorder *module) : ModuleWidget(module) {
                                     Recorder::LEFT_INPUT));
   addInput(Port::create<PJ301MPort>(Vec(10, 90), Port::INPUT, module,
                                     Recorder::RIGHT_INPUT));
+  addInput(Port::create<PJ301MPort>(Vec(10, 115), Port::INPUT, module,
+                                    Recorder::GATE_INPUT));
 
   display = Widget::create<RecordingDisplay>(Vec(5, 140));
   display->recorder = module;
@@ -262,20 +195,11 @@ RecorderWidget::RecorderWidget(Recorder *module) : ModuleWidget(module) {
   button = ParamWidget::create<RecordButton>(
       Vec(7.5, 200), module, Recorder::RECORD_BUTTON, 0.0f, 1.0f, 0.0f);
   addParam(button);
+  gate_input = Recorder::GATE_INPUT;
+  addLevels(Vec(5, 298), Vec(35, 50));
   addParam(ParamWidget::create<CKSS>(Vec(15, 260), module,
                                      Recorder::MONO_STEREO, 0.0f, 1.0f, 0.0f));
 }
 
-void RecorderWidget::fromJson(json_t *rootJ) {
-  ModuleWidget::fromJson(rootJ);
-  button->setValue(0.0); // Make sure the Recorder isn't recording initially.
-}
-
-void RecorderWidget::step() {
-  display->recording = recorder->recording;
-  display->setSeconds(recorder->getSeconds());
-  display->setDisplay(recorder->format);
-}
-
 Model *modelRecorder = Model::create<Recorder, RecorderWidget>(
     "MicroTools", "Recorder", "Recorder", RECORDING_TAG);
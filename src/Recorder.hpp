@@ -0,0 +1,525 @@
+#pragma once
+
+#include "MicroTools.hpp"
+#include "TimingMenu.hpp"
+#include "recordercore.hpp"
+
+// A RecorderCore as a Rack module: the patch settings, the engine's sample
+// rate, the gate input, and linked Recorders clocked in engine order.
+struct RecorderBase : Module, RecorderCore {
+  bool show_waveform = false; // UI thread, instead of the level meter
+  RecorderBase(int num_params, int num_inputs, int num_outputs, int num_lights,
+               int max_channels)
+      : Module(num_params, num_inputs, num_outputs, num_lights),
+        RecorderCore(max_channels, engineGetSampleRate()) {}
+
+  void onSampleRateChange() override { setSampleRate(engineGetSampleRate()); }
+
+  json_t *toJson() override;
+  void fromJson(json_t *rootJ) override;
+
+protected:
+  void findClock(RecordLink &link) override;
+
+  // Whether to record: the gate while it is patched, otherwise the button.
+  // It is read every frame, so a gate starts and stops the take on the exact
+  // frame it changes. The gate goes high at 1V and low again under 0.1V.
+  // Unplugging the gate stops the take: the panel shows the gate's state on
+  // the button, so the button only takes over once that changes.
+  bool recordRequest(const Param &button, const Input &gate) {
+    bool pressed = button.value > 0;
+    if (gate.active) {
+      gate_high = gate_high ? gate.value >= 0.1f : gate.value >= 1.0f;
+      unplugged = true;
+      unplugged_button = pressed;
+      return gate_high;
+    }
+    gate_high = false;
+    if (unplugged and pressed != unplugged_button) {
+      unplugged = false;
+    }
+    return pressed and not unplugged;
+  }
+
+private:
+  bool gate_high = false;
+  // Set while the button hasn't changed since the gate was unplugged
+  bool unplugged = false;
+  bool unplugged_button = false;
+};
+
+struct RecordButton : SVGSwitch, ToggleSwitch {
+  RecordButton() {
+    addFrame(SVG::load(assetPlugin(plugin, "res/DarkButton.svg")));
+    addFrame(SVG::load(assetPlugin(plugin, "res/LightButton.svg")));
+  }
+};
+
+struct FormatItem : MenuItem {
+  SampleFmt format;
+  RecorderBase *recorder;
+  FormatItem(SampleFmt format, RecorderBase *recorder) {
+    this->format = format;
+    this->text = toString(format);
+    this->recorder = recorder;
+    this->rightText = CHECKMARK(format == recorder->getSettings().format);
+  }
+
+  // on click, set the Recorder to use the selected format.
+  void onAction(EventAction &e) override {
+    RecorderSettings settings = recorder->getSettings();
+    settings.format = this->format;
+    recorder->setSettings(settings);
+  }
+};
+
+// Shows the waveform of the take instead of the level meter
+struct WaveformItem : MenuItem {
+  RecorderBase *recorder;
+  WaveformItem(RecorderBase *recorder) {
+    this->text = "Show waveform";
+    this->recorder = recorder;
+    this->rightText = CHECKMARK(recorder->show_waveform);
+  }
+
+  void onAction(EventAction &e) override {
+    recorder->show_waveform = not recorder->show_waveform;
+  }
+};
+
+struct DitherItem : MenuItem {
+  RecorderBase *recorder;
+  DitherItem(RecorderBase *recorder) {
+    this->text = "TPDF dither (8/16 bit)";
+    this->recorder = recorder;
+    this->rightText = CHECKMARK(recorder->getSettings().dither);
+  }
+
+  void onAction(EventAction &e) override {
+    RecorderSettings settings = recorder->getSettings();
+    settings.dither = not settings.dither;
+    recorder->setSettings(settings);
+  }
+};
+
+struct SplitItem : MenuItem {
+  RecorderBase *recorder;
+  SplitItem(RecorderBase *recorder) {
+    this->text = "Separate file per channel";
+    this->recorder = recorder;
+    this->rightText = CHECKMARK(recorder->getSettings().split);
+  }
+
+  void onAction(EventAction &e) override {
+    RecorderSettings settings = recorder->getSettings();
+    settings.split = not settings.split;
+    recorder->setSettings(settings);
+  }
+};
+
+struct SampleRateItem : MenuItem {
+  int rate;
+  RecorderBase *recorder;
+  SampleRateItem(int rate, RecorderBase *recorder) {
+    this->rate = rate;
+    this->text = rate == 0 ? "Engine rate" : std::to_string(rate) + " Hz";
+    this->recorder = recorder;
+    this->rightText = CHECKMARK(rate == recorder->getSettings().output_rate);
+  }
+
+  void onAction(EventAction &e) override {
+    RecorderSettings settings = recorder->getSettings();
+    settings.output_rate = rate;
+    recorder->setSettings(settings);
+  }
+};
+
+struct ResampleQualityItem : MenuItem {
+  int quality;
+  RecorderBase *recorder;
+  ResampleQualityItem(int quality, RecorderBase *recorder) {
+    this->quality = quality;
+    this->text = src_get_name(quality);
+    this->recorder = recorder;
+    this->rightText =
+        CHECKMARK(quality == recorder->getSettings().resample_quality);
+  }
+
+  void onAction(EventAction &e) override {
+    RecorderSettings settings = recorder->getSettings();
+    settings.resample_quality = quality;
+    recorder->setSettings(settings);
+  }
+};
+
+// Output sample rate and resampler quality, in a submenu
+struct SampleRateMenuItem : MenuItem {
+  RecorderBase *recorder;
+  SampleRateMenuItem(RecorderBase *recorder) {
+    this->text = "Sample rate";
+    this->recorder = recorder;
+    this->rightText = RIGHT_ARROW;
+  }
+
+  Menu *createChildMenu() override {
+    static const int rates[] = {0, 44100, 48000, 88200, 96000};
+    static const int qualities[] = {SRC_SINC_BEST_QUALITY,
+                                    SRC_SINC_MEDIUM_QUALITY, SRC_SINC_FASTEST,
+                                    SRC_LINEAR};
+    Menu *menu = new Menu();
+    for (int rate : rates) {
+      menu->addChild(new SampleRateItem(rate, recorder));
+    }
+    menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Resampler"));
+    for (int quality : qualities) {
+      menu->addChild(new ResampleQualityItem(quality, recorder));
+    }
+    return menu;
+  }
+};
+
+struct SinkItem : MenuItem {
+  SinkType sink;
+  RecorderBase *recorder;
+  SinkItem(SinkType sink, RecorderBase *recorder) {
+    this->sink = sink;
+    this->text = toString(sink);
+    this->recorder = recorder;
+    this->rightText = CHECKMARK(sink == recorder->getSettings().sink);
+  }
+
+  void onAction(EventAction &e) override {
+    RecorderSettings settings = recorder->getSettings();
+    settings.sink = sink;
+    recorder->setSettings(settings);
+  }
+};
+
+// How the files are written to disk, in a submenu
+struct SinkMenuItem : MenuItem {
+  RecorderBase *recorder;
+  SinkMenuItem(RecorderBase *recorder) {
+    this->text = "Disk writes";
+    this->recorder = recorder;
+    this->rightText = RIGHT_ARROW;
+  }
+
+  Menu *createChildMenu() override {
+    Menu *menu = new Menu();
+    menu->addChild(new SinkItem(SinkType::STDIO_SINK, recorder));
+    menu->addChild(new SinkItem(SinkType::MMAP_SINK, recorder));
+    menu->addChild(new SinkItem(SinkType::DIRECT_SINK, recorder));
+    return menu;
+  }
+};
+
+struct ThresholdItem : MenuItem {
+  int db;
+  RecorderBase *recorder;
+  ThresholdItem(int db, RecorderBase *recorder) {
+    this->db = db;
+    this->text = db == 0 ? "Off" : std::to_string(db) + " dB";
+    this->recorder = recorder;
+    this->rightText = CHECKMARK(db == recorder->getSettings().threshold_db);
+  }
+
+  void onAction(EventAction &e) override {
+    RecorderSettings settings = recorder->getSettings();
+    settings.threshold_db = db;
+    recorder->setSettings(settings);
+  }
+};
+
+struct SilenceItem : MenuItem {
+  float seconds;
+  RecorderBase *recorder;
+  SilenceItem(float seconds, RecorderBase *recorder) {
+    this->seconds = seconds;
+    this->text = stringf("%g s", seconds);
+    this->recorder = recorder;
+    this->rightText =
+        CHECKMARK(seconds == recorder->getSettings().silence_seconds);
+  }
+
+  void onAction(EventAction &e) override {
+    RecorderSettings settings = recorder->getSettings();
+    settings.silence_seconds = seconds;
+    recorder->setSettings(settings);
+  }
+};
+
+// The level under which auto-split pauses the take, and for how long it has
+// to be quiet first, in a submenu
+struct AutoSplitMenuItem : MenuItem {
+  RecorderBase *recorder;
+  AutoSplitMenuItem(RecorderBase *recorder) {
+    this->text = "Auto-split";
+    this->recorder = recorder;
+    this->rightText = RIGHT_ARROW;
+  }
+
+  Menu *createChildMenu() override {
+    static const int thresholds[] = {0, -72, -60, -48, -36};
+    static const float silences[] = {0.5f, 1, 2, 5, 10};
+    Menu *menu = new Menu();
+    menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Threshold"));
+    for (int db : thresholds) {
+      menu->addChild(new ThresholdItem(db, recorder));
+    }
+    menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Silence"));
+    for (float seconds : silences) {
+      menu->addChild(new SilenceItem(seconds, recorder));
+    }
+    return menu;
+  }
+};
+
+struct PrerollItem : MenuItem {
+  float seconds;
+  RecorderBase *recorder;
+  PrerollItem(float seconds, RecorderBase *recorder) {
+    this->seconds = seconds;
+    this->text = seconds == 0 ? "Off" : std::to_string(int(seconds)) + " s";
+    this->recorder = recorder;
+    this->rightText = CHECKMARK(seconds == recorder->preroll_seconds);
+  }
+
+  void onAction(EventAction &e) override { recorder->setPreroll(seconds); }
+};
+
+struct LinkItem : MenuItem {
+  int group;
+  RecorderBase *recorder;
+  LinkItem(int group, RecorderBase *recorder) {
+    static const char *names[NUM_LINK_GROUPS] = {"Group A", "Group B",
+                                                 "Group C", "Group D"};
+    this->group = group;
+    this->text = group < 0 ? "Not linked" : names[group];
+    this->recorder = recorder;
+    this->rightText = CHECKMARK(group == recorder->getSettings().link_group);
+  }
+
+  void onAction(EventAction &e) override {
+    RecorderSettings settings = recorder->getSettings();
+    settings.link_group = group;
+    recorder->setSettings(settings);
+  }
+};
+
+struct RecordingDisplay : LedDisplay {
+  char msg[8] = {0};
+  bool recording = false;
+
+  LedDisplayChoice *timerText = nullptr;
+  LedDisplaySeparator *separator = nullptr;
+  LedDisplayChoice *formatChoice = nullptr;
+  RecorderBase *recorder;
+
+  RecordingDisplay() {
+    box.size = Vec(35, 44);
+    Vec pos = Vec(0, 0);
+    timerText = Widget::create<LedDisplayChoice>(pos);
+    timerText->textOffset = Vec(3, 14);
+    timerText->box.size = Vec(35, 22);
+    pos = timerText->box.getBottomLeft();
+    setSeconds(0);
+    addChild(timerText);
+
+    separator = Widget::create<LedDisplaySeparator>(pos);
+    separator->box.size.x = box.size.x;
+    addChild(separator);
+
+    formatChoice = Widget::create<LedDisplayChoice>(pos);
+    formatChoice->textOffset = Vec(3, 14);
+    formatChoice->box.size = Vec(35, 22);
+    pos = formatChoice->box.getBottomLeft();
+    addChild(formatChoice);
+  }
+
+  void setSeconds(float seconds) {
+    float frac_second = seconds - int(seconds);
+    if (seconds > 60 * 60) {
+      seconds /= 60;
+    }
+
+    int a = int(seconds) / 60, b = int(seconds) % 60;
+
+    // Blink the : every second
+    if (frac_second < 0.5 or not recording) {
+      sprintf(msg, "%02d:%02d", a, b);
+    } else {
+      sprintf(msg, "%02d %02d", a, b);
+    }
+
+    timerText->text = msg;
+  }
+
+  void setDisplay(SampleFmt format) {
+    switch (format) {
+    case SampleFmt::PCM_U8:
+      formatChoice->text = "8 USI";
+      break;
+    case SampleFmt::PCM_S16:
+      formatChoice->text = "16 SI";
+      break;
+    case SampleFmt::FLOAT_32:
+      formatChoice->text = "32 FL";
+      break;
+    case SampleFmt::FLAC_16:
+      formatChoice->text = "FLAC";
+      break;
+    default:
+      formatChoice->text = "ERROR";
+      break;
+    }
+  }
+
+  void onMouseDown(EventMouseDown &e) override {
+    Menu *menu = gScene->createMenu();
+    const MeterLevels &levels = recorder->meter.levels();
+    uint32_t clips = 0;
+    for (int c = 0; c < levels.num_channels; c++) {
+      clips += levels.clips[c];
+    }
+    if (clips > 0) {
+      menu->addChild(construct<MenuLabel>(
+          &MenuLabel::text, "Clipped samples: " + std::to_string(clips)));
+    }
+    size_t dropped = recorder->getStatus().num_dropped;
+    if (dropped > 0) {
+      menu->addChild(construct<MenuLabel>(
+          &MenuLabel::text,
+          stringf("Dropped: %.1f s, disk too slow",
+                  dropped / engineGetSampleRate())));
+    }
+    menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Format"));
+    if (recorder->getStatus().armed) {
+      menu->addChild(MenuItem::create("Can't change formats while recording!"));
+    } else {
+      menu->addChild(new FormatItem(SampleFmt::PCM_U8, recorder));
+      menu->addChild(new FormatItem(SampleFmt::PCM_S16, recorder));
+      menu->addChild(new FormatItem(SampleFmt::FLOAT_32, recorder));
+      menu->addChild(new FormatItem(SampleFmt::FLAC_16, recorder));
+      menu->addChild(new DitherItem(recorder));
+      menu->addChild(new SplitItem(recorder));
+      menu->addChild(new SampleRateMenuItem(recorder));
+      menu->addChild(new SinkMenuItem(recorder));
+      menu->addChild(new AutoSplitMenuItem(recorder));
+      menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Pre-roll"));
+      static const float prerolls[] = {0, 1, 5, 10, 30};
+      for (float seconds : prerolls) {
+        menu->addChild(new PrerollItem(seconds, recorder));
+      }
+      menu->addChild(construct<MenuLabel>(&MenuLabel::text, "Link"));
+      for (int group = -1; group < NUM_LINK_GROUPS; group++) {
+        menu->addChild(new LinkItem(group, recorder));
+      }
+    }
+    menu->addChild(new WaveformItem(recorder));
+  }
+};
+
+// A level meter per channel: the bar is the RMS level, the line above it the
+// held peak, and the top turns red once the channel has clipped in the take.
+struct LevelMeter : TransparentWidget {
+  MeterLevels levels;
+
+  // Height of a level as a share of the meter, over the bottom 60dB
+  static float height(float volts) {
+    float db = 20.0f * log10f(volts / METER_CLIP_VOLTAGE + 1e-9f);
+    return clamp((db + 60.0f) / 60.0f, 0.0f, 1.0f);
+  }
+
+  void draw(NVGcontext *vg) override {
+    nvgBeginPath(vg);
+    nvgRect(vg, 0, 0, box.size.x, box.size.y);
+    nvgFillColor(vg, nvgRGB(0x20, 0x20, 0x20));
+    nvgFill(vg);
+    if (levels.num_channels == 0) {
+      return;
+    }
+    float width = box.size.x / levels.num_channels;
+    for (int c = 0; c < levels.num_channels; c++) {
+      float x = c * width + 0.5f;
+      float rms = height(levels.rms[c]) * box.size.y;
+      nvgBeginPath(vg);
+      nvgRect(vg, x, box.size.y - rms, width - 1.0f, rms);
+      nvgFillColor(vg, nvgRGB(0x30, 0xc0, 0x40));
+      nvgFill(vg);
+
+      float peak = box.size.y - height(levels.peak[c]) * box.size.y;
+      nvgBeginPath(vg);
+      nvgRect(vg, x, peak, width - 1.0f, 1.0f);
+      nvgFillColor(vg, nvgRGB(0xe0, 0xe0, 0x40));
+      nvgFill(vg);
+
+      if (levels.clips[c] > 0) {
+        nvgBeginPath(vg);
+        nvgRect(vg, x, 0, width - 1.0f, 3.0f);
+        nvgFillColor(vg, nvgRGB(0xff, 0x20, 0x20));
+        nvgFill(vg);
+      }
+    }
+  }
+};
+
+// The waveform of the take so far, squeezed into the width of the widget,
+// with full scale at the edges. It comes from the Recorder's Overview, so a
+// frame costs the same to draw however long the take is.
+struct WaveformDisplay : TransparentWidget {
+  RecorderBase *recorder;
+  std::vector<MinMax> columns;
+
+  void draw(NVGcontext *vg) override {
+    nvgBeginPath(vg);
+    nvgRect(vg, 0, 0, box.size.x, box.size.y);
+    nvgFillColor(vg, nvgRGB(0x20, 0x20, 0x20));
+    nvgFill(vg);
+    if (not recorder->overview.read(int(box.size.x), columns)) {
+      return;
+    }
+    float middle = box.size.y / 2;
+    float scale = middle / METER_CLIP_VOLTAGE;
+    nvgBeginPath(vg);
+    for (size_t x = 0; x < columns.size(); x++) {
+      float top = middle - clamp(columns[x].max * scale, -middle, middle);
+      float bottom = middle - clamp(columns[x].min * scale, -middle, middle);
+      nvgRect(vg, x, top, 1.0f, std::max(bottom - top, 1.0f));
+    }
+    nvgFillColor(vg, nvgRGB(0x30, 0xc0, 0x40));
+    nvgFill(vg);
+  }
+};
+
+// The panel logic shared by the Recorder modules. Subclasses lay out the
+// ports, create `display` and `button`, and place the levels.
+struct RecorderBaseWidget : ModuleWidget {
+  RecorderBase *recorder;
+  RecordingDisplay *display;
+  RecordButton *button;
+  int gate_input; // whose gate takes over from the button
+  LevelMeter *meter;
+  WaveformDisplay *waveform; // in the same place, one of them is shown
+  bool last_armed = false;
+
+  RecorderBaseWidget(RecorderBase *module) : ModuleWidget(module) {
+    recorder = module;
+  }
+  void addLevels(Vec pos, Vec size) {
+    meter = Widget::create<LevelMeter>(pos);
+    meter->box.size = size;
+    addChild(meter);
+    waveform = Widget::create<WaveformDisplay>(pos);
+    waveform->box.size = size;
+    waveform->recorder = recorder;
+    addChild(waveform);
+  }
+  void step() override;
+  void fromJson(json_t *rootJ) override;
+
+#ifdef MICROTOOLS_PROFILE
+  void appendContextMenu(Menu *menu) override {
+    appendTimingMenu(menu, recorder->timing, model->slug);
+  }
+#endif
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "MicroTools.hpp"
+#include "osdialog.h"
+#include "timing.hpp"
+
+#ifdef MICROTOOLS_PROFILE
+
+// A time in the units that suit it
+inline std::string formatNs(double ns) {
+  if (ns < 1000) {
+    return stringf("%.0f ns", ns);
+  }
+  if (ns < 1e6) {
+    return stringf("%.1f us", ns / 1e3);
+  }
+  return stringf("%.1f ms", ns / 1e6);
+}
+
+struct ResetTimingItem : MenuItem {
+  StepTiming *timing;
+  ResetTimingItem(StepTiming *timing) {
+    this->text = "Reset";
+    this->timing = timing;
+  }
+
+  void onAction(EventAction &e) override { timing->reset(); }
+};
+
+// Writes the timing so far to a file picked by the user
+struct SaveTimingItem : MenuItem {
+  StepTiming *timing;
+  std::string module;
+  bool json;
+  SaveTimingItem(StepTiming *timing, const std::string &module, bool json) {
+    this->text = json ? "Save as JSON..." : "Save as CSV...";
+    this->timing = timing;
+    this->module = module;
+    this->json = json;
+  }
+
+  void onAction(EventAction &e) override {
+    osdialog_filters *filters =
+        osdialog_filters_parse(json ? "JSON:json" : "CSV:csv");
+    char *path = osdialog_file(OSDIALOG_SAVE, nullptr,
+                               json ? "timing.json" : "timing.csv", filters);
+    osdialog_filters_free(filters);
+    if (not path) {
+      return;
+    }
+    if (FILE *f = fopen(path, "w")) {
+      TimingReport report = timing->report();
+      if (json) {
+        report.writeJson(f, module.c_str());
+      } else {
+        report.writeCsv(f, module.c_str());
+      }
+      fclose(f);
+    }
+    free(path);
+  }
+};
+
+// The histogram as it was when the menu opened, one line per bucket in use
+struct TimingMenuItem : MenuItem {
+  StepTiming *timing;
+  std::string module;
+  TimingMenuItem(StepTiming *timing, const std::string &module) {
+    this->text = "Step timing";
+    this->timing = timing;
+    this->module = module;
+    this->rightText = RIGHT_ARROW;
+  }
+
+  Menu *createChildMenu() override {
+    TimingReport report = timing->report();
+    Menu *menu = new Menu();
+    menu->addChild(construct<MenuLabel>(
+        &MenuLabel::text,
+        stringf("%llu steps, mean %s, worst %s",
+                (unsigned long long)report.steps,
+                formatNs(report.steps ? report.total_ns / report.steps : 0)
+                    .c_str(),
+                formatNs(report.worst_ns).c_str())));
+    for (int i = 0; i < TIMING_BUCKETS; i++) {
+      if (report.buckets[i]) {
+        menu->addChild(construct<MenuLabel>(
+            &MenuLabel::text,
+            stringf("%s - %s: %llu (%.3g%%)",
+                    formatNs(report.bucketNs(i)).c_str(),
+                    formatNs(report.bucketNs(i + 1)).c_str(),
+                    (unsigned long long)report.buckets[i],
+                    100.0 * report.buckets[i] / report.steps)));
+      }
+    }
+    for (int e = 0; e < NUM_TIMING_EVENTS; e++) {
+      if (report.events[e]) {
+        menu->addChild(construct<MenuLabel>(
+            &MenuLabel::text,
+            stringf("%s: %llu, worst %s", toString(TimingEvent(e)),
+                    (unsigned long long)report.events[e],
+                    formatNs(report.event_worst_ns[e]).c_str())));
+      }
+    }
+    menu->addChild(new ResetTimingItem(timing));
+    menu->addChild(new SaveTimingItem(timing, module, true));
+    menu->addChild(new SaveTimingItem(timing, module, false));
+    return menu;
+  }
+};
+
+// Adds the timing of a module's step() to its context menu
+inline void appendTimingMenu(Menu *menu, StepTiming &timing,
+                             const std::string &module) {
+  menu->addChild(construct<MenuLabel>());
+  menu->addChild(new TimingMenuItem(&timing, module));
+}
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+// Frames the modules process at once. Each module's step() is an adapter
+// over its DSP core: once every STEP_BLOCK frames it reads the knobs and CV
+// and runs the core over the whole block, and in between it only hands out
+// frames. The controls are a block late at most, 0.7ms at 44.1kHz.
+#define STEP_BLOCK 32
+
+// The frames a DSP core made for the next STEP_BLOCK calls of step(), handed
+// out one at a time.
+template <int CHANNELS> struct OutputBlock {
+  // True when every frame has been handed out, so the core has to run
+  bool due() const { return pos == STEP_BLOCK; }
+  // Where the core writes the next block, STEP_BLOCK interleaved frames
+  float *fill() {
+    pos = 0;
+    return &frames[0][0];
+  }
+  const float *next() { return frames[pos++]; }
+
+private:
+  alignas(16) float frames[STEP_BLOCK][CHANNELS];
+  int pos = STEP_BLOCK;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ringbuffer.hpp"
+
+// Commands a module can have waiting before the audio thread gets to them
+#define COMMAND_QUEUE_CAPACITY 64
+
+// Carries changes made on the UI thread (menus, loading a patch) over to the
+// audio thread without locks. The UI thread send()s commands; the audio
+// thread calls apply() at the start of step(), so every change takes effect
+// between two frames and never halfway through one. Neither side ever waits.
+//
+// Exactly one thread may send, and one (other) thread may apply.
+template <typename T> struct CommandQueue {
+  CommandQueue() : commands(COMMAND_QUEUE_CAPACITY) {}
+
+  // UI thread. Returns false (and drops the command) if the audio thread
+  // hasn't applied the previous COMMAND_QUEUE_CAPACITY yet.
+  bool send(const T &command) { return commands.push(command); }
+
+  // Audio thread. Calls `f` on each command sent so far, oldest first.
+  template <typename F> void apply(F f) {
+    T command;
+    while (commands.pop(command)) {
+      f(command);
+    }
+  }
+
+private:
+  SPSCRing<T> commands;
+};
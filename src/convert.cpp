@@ -0,0 +1,262 @@
+#include "convert.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+// Note: Audio output from Eurorack devices is +-12V, and wav files are
+// expecting samples between -1 and 1.
+static const float VOLTAGE_SCALE = 1.0f / 12.0f;
+
+// Full scale and clipping range of the integer formats, in LSBs. U8 is
+// stored offset by 128.
+static const float S16_SCALE = 32767.0f * VOLTAGE_SCALE;
+static const float S16_MIN = -32768.0f, S16_MAX = 32767.0f;
+static const float U8_SCALE = 127.0f * VOLTAGE_SCALE;
+static const float U8_MIN = -128.0f, U8_MAX = 127.0f;
+
+Dither::Dither(uint32_t seed) {
+  for (int i = 0; i < 8; i++) {
+    // Any nonzero seed works for xorshift, just make the lanes differ.
+    state[i] = seed ^ (0x6d2b79f5u * (i + 1));
+    if (state[i] == 0) {
+      state[i] = 1;
+    }
+  }
+}
+
+static inline uint32_t xorshift(uint32_t &s) {
+  s ^= s << 13;
+  s ^= s >> 17;
+  s ^= s << 5;
+  return s;
+}
+
+// Uniform float in [-0.5, 0.5), built by stuffing random bits into the
+// mantissa of a float in [1, 2).
+static inline float uniform(uint32_t &s) {
+  uint32_t bits = (xorshift(s) >> 9) | 0x3f800000u;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f - 1.5f;
+}
+
+// The sum of two uniform variables has a triangular distribution over
+// +-1 LSB, which decorrelates the quantization error from the signal.
+static inline float tpdf(uint32_t &s) { return uniform(s) + uniform(s); }
+
+static inline float clip(float x, float lo, float hi) {
+  return x < lo ? lo : (x > hi ? hi : x);
+}
+
+void convert_scalar(SampleFmt format, const float *in, uint8_t *out, size_t n,
+                    Dither *dither) {
+  switch (format) {
+  case SampleFmt::PCM_U8:
+    for (size_t i = 0; i < n; i++) {
+      float x = in[i] * U8_SCALE;
+      if (dither) {
+        x += tpdf(dither->state[0]);
+      }
+      out[i] = static_cast<uint8_t>(lrintf(clip(x, U8_MIN, U8_MAX)) + 128);
+    }
+    break;
+  case SampleFmt::PCM_S16:
+    for (size_t i = 0; i < n; i++) {
+      float x = in[i] * S16_SCALE;
+      if (dither) {
+        x += tpdf(dither->state[0]);
+      }
+      int16_t sample = static_cast<int16_t>(lrintf(clip(x, S16_MIN, S16_MAX)));
+      memcpy(out + 2 * i, &sample, sizeof(sample));
+    }
+    break;
+  case SampleFmt::FLOAT_32:
+    for (size_t i = 0; i < n; i++) {
+      float sample = in[i] * VOLTAGE_SCALE;
+      memcpy(out + 4 * i, &sample, sizeof(sample));
+    }
+    break;
+  default:
+    assert(not"an expected format");
+  }
+}
+
+#ifdef CONVERT_X86
+
+// SSE2 is part of x86_64 (and of the -march Rack builds with), so this path
+// needs no runtime check.
+
+static inline __m128 uniform_sse(__m128i &s) {
+  s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+  s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+  s = _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+  __m128i bits = _mm_or_si128(_mm_srli_epi32(s, 9), _mm_set1_epi32(0x3f800000));
+  return _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.5f));
+}
+
+// Scales, dithers, clips and rounds 4 samples to int32 lanes.
+template <bool DITHER>
+static inline __m128i quantize_sse(const float *in, __m128 scale, __m128 lo,
+                                   __m128 hi, __m128i &s) {
+  __m128 x = _mm_mul_ps(_mm_loadu_ps(in), scale);
+  if (DITHER) {
+    x = _mm_add_ps(x, _mm_add_ps(uniform_sse(s), uniform_sse(s)));
+  }
+  x = _mm_min_ps(_mm_max_ps(x, lo), hi);
+  return _mm_cvtps_epi32(x);
+}
+
+template <bool DITHER>
+static size_t convert_sse(SampleFmt format, const float *in, uint8_t *out,
+                          size_t n, Dither *dither) {
+  __m128i s = _mm_setzero_si128();
+  if (DITHER) {
+    s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dither->state));
+  }
+  size_t i = 0;
+  switch (format) {
+  case SampleFmt::PCM_U8: {
+    __m128 scale = _mm_set1_ps(U8_SCALE);
+    __m128 lo = _mm_set1_ps(U8_MIN), hi = _mm_set1_ps(U8_MAX);
+    __m128i offset = _mm_set1_epi32(128);
+    for (; i + 4 <= n; i += 4) {
+      __m128i v = _mm_add_epi32(quantize_sse<DITHER>(in + i, scale, lo, hi, s),
+                                offset);
+      v = _mm_packs_epi32(v, v);
+      v = _mm_packus_epi16(v, v);
+      int32_t packed = _mm_cvtsi128_si32(v);
+      memcpy(out + i, &packed, sizeof(packed));
+    }
+    break;
+  }
+  case SampleFmt::PCM_S16: {
+    __m128 scale = _mm_set1_ps(S16_SCALE);
+    __m128 lo = _mm_set1_ps(S16_MIN), hi = _mm_set1_ps(S16_MAX);
+    for (; i + 4 <= n; i += 4) {
+      __m128i v = quantize_sse<DITHER>(in + i, scale, lo, hi, s);
+      v = _mm_packs_epi32(v, v);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 2 * i), v);
+    }
+    break;
+  }
+  case SampleFmt::FLOAT_32: {
+    __m128 scale = _mm_set1_ps(VOLTAGE_SCALE);
+    for (; i + 4 <= n; i += 4) {
+      __m128 x = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+      _mm_storeu_ps(reinterpret_cast<float *>(out + 4 * i), x);
+    }
+    break;
+  }
+  default:
+    assert(not"an expected format");
+  }
+  if (DITHER) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dither->state), s);
+  }
+  return i;
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256 uniform_avx2(__m256i &s) {
+  s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 13));
+  s = _mm256_xor_si256(s, _mm256_srli_epi32(s, 17));
+  s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 5));
+  __m256i bits =
+      _mm256_or_si256(_mm256_srli_epi32(s, 9), _mm256_set1_epi32(0x3f800000));
+  return _mm256_sub_ps(_mm256_castsi256_ps(bits), _mm256_set1_ps(1.5f));
+}
+
+// Scales, dithers, clips and rounds 8 samples, then saturates them down to
+// 8 int16 lanes.
+template <bool DITHER>
+AVX2 static inline __m128i quantize_avx2(const float *in, __m256 scale,
+                                         __m256 lo, __m256 hi, __m256i offset,
+                                         __m256i &s) {
+  __m256 x = _mm256_mul_ps(_mm256_loadu_ps(in), scale);
+  if (DITHER) {
+    x = _mm256_add_ps(x, _mm256_add_ps(uniform_avx2(s), uniform_avx2(s)));
+  }
+  x = _mm256_min_ps(_mm256_max_ps(x, lo), hi);
+  __m256i v = _mm256_add_epi32(_mm256_cvtps_epi32(x), offset);
+  // The 256 bit packs work per 128 bit lane, so pack the halves by hand.
+  return _mm_packs_epi32(_mm256_castsi256_si128(v),
+                         _mm256_extracti128_si256(v, 1));
+}
+
+template <bool DITHER>
+AVX2 static size_t convert_avx2(SampleFmt format, const float *in,
+                                uint8_t *out, size_t n, Dither *dither) {
+  __m256i s = _mm256_setzero_si256();
+  if (DITHER) {
+    s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dither->state));
+  }
+  size_t i = 0;
+  switch (format) {
+  case SampleFmt::PCM_U8: {
+    __m256 scale = _mm256_set1_ps(U8_SCALE);
+    __m256 lo = _mm256_set1_ps(U8_MIN), hi = _mm256_set1_ps(U8_MAX);
+    __m256i offset = _mm256_set1_epi32(128);
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = quantize_avx2<DITHER>(in + i, scale, lo, hi, offset, s);
+      _mm_storel_epi64(reinterpret_cast<__m128i *>(out + i),
+                       _mm_packus_epi16(v, v));
+    }
+    break;
+  }
+  case SampleFmt::PCM_S16: {
+    __m256 scale = _mm256_set1_ps(S16_SCALE);
+    __m256 lo = _mm256_set1_ps(S16_MIN), hi = _mm256_set1_ps(S16_MAX);
+    __m256i offset = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = quantize_avx2<DITHER>(in + i, scale, lo, hi, offset, s);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), v);
+    }
+    break;
+  }
+  case SampleFmt::FLOAT_32: {
+    __m256 scale = _mm256_set1_ps(VOLTAGE_SCALE);
+    for (; i + 8 <= n; i += 8) {
+      __m256 x = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+      _mm256_storeu_ps(reinterpret_cast<float *>(out + 4 * i), x);
+    }
+    break;
+  }
+  default:
+    assert(not"an expected format");
+  }
+  if (DITHER) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dither->state), s);
+  }
+  return i;
+}
+
+#endif
+
+void convert(SampleFmt format, const float *in, uint8_t *out, size_t n,
+             Dither *dither) {
+  if (format == SampleFmt::FLOAT_32) {
+    // Float output is never dithered
+    dither = nullptr;
+  }
+  size_t done = 0;
+#ifdef CONVERT_X86
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  if (has_avx2) {
+    done = dither ? convert_avx2<true>(format, in, out, n, dither)
+                  : convert_avx2<false>(format, in, out, n, dither);
+  } else {
+    done = dither ? convert_sse<true>(format, in, out, n, dither)
+                  : convert_sse<false>(format, in, out, n, dither);
+  }
+#endif
+  // Whatever the vector kernel didn't get to
+  convert_scalar(format, in + done, out + done * sampleBytes(format), n - done,
+                 dither);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "wavwriter.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// State for TPDF (triangular) dither. Each SIMD lane gets its own xorshift
+// generator so the vector paths don't have to serialize on one state.
+struct Dither {
+  uint32_t state[8];
+  explicit Dither(uint32_t seed = 0x9e3779b9);
+};
+
+// Converts `n` samples from Rack voltages (+-12V) to `format`, writing
+// `n * sampleBytes(format)` bytes to `out`. Integer formats are rounded and
+// clipped to their full range, and get TPDF dither of +-1 LSB if `dither` is
+// non-null. FLOAT_32 is only scaled, since floats have headroom past 0dBFS.
+//
+// Picks an AVX2 or SSE2 kernel at runtime when the CPU supports one. Never
+// allocates, so it can be called on any thread.
+void convert(SampleFmt format, const float *in, uint8_t *out, size_t n,
+             Dither *dither = nullptr);
+
+// The portable version of convert(), used for the tails of the SIMD kernels
+// and as the reference implementation.
+void convert_scalar(SampleFmt format, const float *in, uint8_t *out, size_t n,
+                    Dither *dither = nullptr);
@@ -0,0 +1,133 @@
+#include "diskreader.hpp"
+
+#include <algorithm>
+
+DiskReader::DiskReader(size_t capacity, int num_channels)
+    : samples(capacity), num_channels(num_channels) {
+  DiskWorker::get().add(this);
+}
+
+DiskReader::~DiskReader() { DiskWorker::get().remove(this); }
+
+void DiskReader::load(const std::string &filename) {
+  std::lock_guard<std::mutex> lock(mutex);
+  pending_file = filename;
+  has_pending_file = true;
+}
+
+std::string DiskReader::filename() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return has_pending_file ? pending_file : current_file;
+}
+
+void DiskReader::play(uint64_t frame) {
+  request_frame.store(frame, std::memory_order_relaxed);
+  request_playing.store(true, std::memory_order_relaxed);
+  request.fetch_add(1, std::memory_order_release);
+}
+
+void DiskReader::stop() {
+  request_playing.store(false, std::memory_order_relaxed);
+  request.fetch_add(1, std::memory_order_release);
+}
+
+size_t DiskReader::read(float *frames, size_t n) {
+  // Checked first: once the worker is on the latest request, the mark it made
+  // for it is visible below.
+  bool is_ready = ready.load(std::memory_order_acquire) ==
+                  request.load(std::memory_order_relaxed);
+  uint32_t latest = marks.load(std::memory_order_acquire);
+  if (latest != seen_marks) {
+    // Whatever is before the newest mark was read for an older request
+    seen_marks = latest;
+    uint64_t start = mark.load(std::memory_order_relaxed);
+    if (samples.read() < start) {
+      samples.skip(start - samples.read());
+    }
+  }
+  if (not is_ready) {
+    return 0;
+  }
+  return samples.pop(frames, n * num_channels) / num_channels;
+}
+
+bool DiskReader::atEnd() const {
+  return ended.load(std::memory_order_acquire) ==
+             request.load(std::memory_order_relaxed) and
+         samples.readAvailable() == 0;
+}
+
+void DiskReader::newMark() {
+  mark.store(samples.written(), std::memory_order_relaxed);
+  marks.fetch_add(1, std::memory_order_release);
+}
+
+bool DiskReader::service(DiskScratch &scratch) {
+  bool did_work = false;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (has_pending_file) {
+      has_pending_file = false;
+      current_file = pending_file;
+      if (reader.open(current_file.c_str())) {
+        printf("Playing %s (%s, %d channels, %d Hz)\n", current_file.c_str(),
+               toString(reader.info().format), reader.info().num_channels,
+               reader.info().sample_rate);
+      }
+      sample_rate.store(reader.info().sample_rate, std::memory_order_relaxed);
+      num_frames.store(reader.info().samples, std::memory_order_relaxed);
+      // Stop whatever was playing, unless there is a newer request below
+      playing = false;
+      newMark();
+      ended.store(serving, std::memory_order_release);
+      did_work = true;
+    }
+  }
+
+  uint32_t latest = request.load(std::memory_order_acquire);
+  if (latest != serving) {
+    serving = latest;
+    position = request_frame.load(std::memory_order_relaxed);
+    playing = request_playing.load(std::memory_order_relaxed);
+    newMark();
+    ready.store(serving, std::memory_order_release);
+    if (not playing) {
+      ended.store(serving, std::memory_order_release);
+    }
+    did_work = true;
+  }
+
+  if (not playing) {
+    return did_work;
+  }
+  int file_channels = reader.info().num_channels;
+  // Top the ring up a quarter at a time, so a request never waits long
+  size_t frames_per_block =
+      std::min(scratch.block.size() / std::max(file_channels, num_channels),
+               samples.capacity() / num_channels / 4);
+  while (samples.writeAvailable() >= frames_per_block * num_channels and
+         request.load(std::memory_order_relaxed) == serving) {
+    size_t n = reader.read(position, scratch.block.data(), frames_per_block);
+    if (n == 0) {
+      if (looping.load(std::memory_order_relaxed) and position > 0) {
+        position = 0;
+        continue;
+      }
+      playing = false;
+      ended.store(serving, std::memory_order_release);
+      break;
+    }
+    // Pick (or repeat) the file's channels to fill each frame
+    for (size_t i = 0; i < n; i++) {
+      for (int c = 0; c < num_channels; c++) {
+        scratch.track[i * num_channels + c] =
+            scratch.block[i * file_channels + c % file_channels];
+      }
+    }
+    samples.push(scratch.track.data(), n * num_channels);
+    position += n;
+    did_work = true;
+  }
+  return did_work;
+}
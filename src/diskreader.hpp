@@ -0,0 +1,83 @@
+#pragma once
+
+#include "diskworker.hpp"
+#include "ringbuffer.hpp"
+#include "wavreader.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Streams a WAV file to the audio thread.
+//
+// The shared DiskWorker thread reads and converts the file a block at a time
+// into a ring of frames, staying a ring's worth ahead of playback. The audio
+// thread only ever pops from the ring, so it never waits on a read or a page
+// fault, however the file is being read.
+//
+// Requests from the audio thread (play from a frame, stop) are numbered. The
+// worker answers each one by marking the point in the ring where the frames
+// for it start, and the audio thread throws away everything before that.
+struct DiskReader : DiskClient {
+  // `capacity` is the size of the ring, in samples. Frames always have
+  // `num_channels` samples: a mono file fills all of them, a wider file only
+  // gives its first channels.
+  DiskReader(size_t capacity, int num_channels);
+  ~DiskReader();
+
+  // UI thread
+  // Opens `filename` on the worker thread, replacing the current file. Any
+  // playback stops.
+  void load(const std::string &filename);
+  std::string filename();
+
+  // Audio thread
+  void play(uint64_t frame = 0);
+  void stop();
+  void setLoop(bool loop) { looping.store(loop, std::memory_order_relaxed); }
+  // Pops up to `n` frames. Returns how many there were, which is less than `n`
+  // while the worker catches up with a request, or at the end of the file.
+  size_t read(float *frames, size_t n);
+  // True once everything played since the last request has been read
+  bool atEnd() const;
+
+  // Any thread. Both are 0 until a file is loaded.
+  int sampleRate() const { return sample_rate.load(std::memory_order_relaxed); }
+  uint64_t length() const { return num_frames.load(std::memory_order_relaxed); }
+
+  bool service(DiskScratch &scratch) override;
+
+private:
+  SPSCRing<float> samples;
+  const int num_channels;
+  std::atomic<bool> looping{false};
+  std::atomic<int> sample_rate{0};
+  std::atomic<uint64_t> num_frames{0};
+
+  // Guards the file names, which come from the UI thread
+  std::mutex mutex;
+  std::string current_file;
+  std::string pending_file;
+  bool has_pending_file = false;
+
+  // The latest request. `request_frame` and `request_playing` are written
+  // before `request` is bumped.
+  std::atomic<uint32_t> request{0};
+  std::atomic<uint64_t> request_frame{0};
+  std::atomic<bool> request_playing{false};
+  // What the worker has done about them
+  std::atomic<uint32_t> ready{0}; // the request the ring is filling for
+  std::atomic<uint32_t> ended{0}; // the last request played to the end
+  std::atomic<uint64_t> mark{0};  // ring position where `ready` starts
+  std::atomic<uint32_t> marks{0}; // bumped after every new mark
+  uint32_t seen_marks = 0;        // audio thread
+
+  // Worker side
+  WavReader reader;
+  uint32_t serving = 0;
+  uint64_t position = 0;
+  bool playing = false;
+
+  void newMark();
+};
@@ -0,0 +1,52 @@
+#include "diskworker.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+// How long the worker sleeps when there's nothing to do
+#define IDLE_SLEEP std::chrono::milliseconds(10)
+
+DiskScratch::DiskScratch()
+    : block(BLOCK_SIZE), track(BLOCK_SIZE), resampled(BLOCK_SIZE),
+      // Big enough for a block of the widest format
+      bytes(BLOCK_SIZE * sizeof(float)) {}
+
+DiskWorker &DiskWorker::get() {
+  // Started the first time a module that does disk I/O is created
+  static DiskWorker worker;
+  return worker;
+}
+
+DiskWorker::DiskWorker() { thread = std::thread(&DiskWorker::run, this); }
+
+DiskWorker::~DiskWorker() {
+  running = false;
+  thread.join();
+}
+
+void DiskWorker::add(DiskClient *client) {
+  std::lock_guard<std::mutex> lock(mutex);
+  clients.push_back(client);
+}
+
+void DiskWorker::remove(DiskClient *client) {
+  std::lock_guard<std::mutex> lock(mutex);
+  clients.erase(std::remove(clients.begin(), clients.end(), client),
+                clients.end());
+}
+
+void DiskWorker::run() {
+  DiskScratch scratch;
+  while (running) {
+    bool did_work = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (DiskClient *client : clients) {
+        did_work |= client->service(scratch);
+      }
+    }
+    if (not did_work) {
+      std::this_thread::sleep_for(IDLE_SLEEP);
+    }
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How many samples the disk worker converts and writes (or reads) at once
+#define BLOCK_SIZE (1 << 16)
+
+// Scratch memory used while converting and writing a block. Owned by whoever
+// is servicing the clients, so it isn't duplicated per module.
+struct DiskScratch {
+  std::vector<float> block;
+  std::vector<float> track;
+  std::vector<float> resampled;
+  std::vector<uint8_t> bytes;
+  DiskScratch();
+};
+
+// Anything with disk I/O to do in the background, see DiskWorker.
+struct DiskClient {
+  virtual ~DiskClient() {}
+  // Called over and over from the worker thread. Does whatever can be done
+  // without waiting, and returns true if there was anything to do.
+  virtual bool service(DiskScratch &scratch) = 0;
+};
+
+// The one background thread that does the disk I/O of every module in the
+// plugin. Sharing it means one wakeup per pass instead of one per module,
+// and the writes from all recorders are batched together.
+struct DiskWorker {
+  static DiskWorker &get();
+
+  void add(DiskClient *client);
+  // After this returns the worker will not touch `client` again.
+  void remove(DiskClient *client);
+
+private:
+  DiskWorker();
+  ~DiskWorker();
+
+  std::mutex mutex; // guards `clients`
+  std::vector<DiskClient *> clients;
+  std::atomic<bool> running{true};
+  std::thread thread;
+
+  void run();
+};
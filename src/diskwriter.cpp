@@ -0,0 +1,337 @@
+#include "diskwriter.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <vector>
+
+// How often (in seconds of recorded audio) the headers of the files being
+// written are brought up to date and their buffers flushed, bounding how much
+// of a take is lost if the process dies
+#define CHECKPOINT_SECONDS 1
+
+// Returns true if the filename exists
+static bool file_exists(const std::string &name) {
+  if (FILE *file = fopen(name.c_str(), "r")) {
+    fclose(file);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+// Returns the highest N of the recordingN.wav, recordingN-T.wav (and .flac)
+// files in the working directory, or 0 if there are none.
+static int highest_take_index() {
+  int highest = 0;
+  DIR *dir = opendir(".");
+  if (not dir) {
+    return highest;
+  }
+  const char *prefix = "recording";
+  size_t prefix_length = strlen(prefix);
+  while (dirent *entry = readdir(dir)) {
+    const char *name = entry->d_name;
+    if (strncmp(name, prefix, prefix_length) != 0) {
+      continue;
+    }
+    char *end;
+    long index = strtol(name + prefix_length, &end, 10);
+    if (end != name + prefix_length and (*end == '.' or *end == '-')) {
+      highest = std::max<long>(highest, index);
+    }
+  }
+  closedir(dir);
+  return highest;
+}
+
+// Reserves the number of a new take. The directory is only scanned for the
+// first take, after that a counter shared by all writers is incremented, so
+// starting a take costs the same however many recordings already exist.
+static int next_take_index() {
+  static std::atomic<int> next(highest_take_index() + 1);
+  return next++;
+}
+
+DiskWriter::DiskWriter(size_t capacity) : samples(capacity), commands(16) {
+  DiskWorker::get().add(this);
+}
+
+DiskWriter::~DiskWriter() { finish(); }
+
+void DiskWriter::finish() {
+  if (finished) {
+    return;
+  }
+  finished = true;
+  DiskWorker::get().remove(this);
+  // Whatever the worker hadn't gotten to yet
+  DiskScratch scratch;
+  service(scratch);
+  close(scratch);
+}
+
+bool DiskWriter::start(const TakeSettings &settings, const Preroll &preroll) {
+  Command command;
+  command.type = Command::START;
+  command.position = samples.written();
+  command.settings = settings;
+  command.preroll = preroll;
+  return commands.push(command);
+}
+
+bool DiskWriter::push(const float *data, size_t n) {
+  if (not samples.push(data, n)) {
+    dropped.fetch_add(n, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+bool DiskWriter::stop() {
+  Command command;
+  command.type = Command::STOP;
+  command.position = samples.written();
+  return commands.push(command);
+}
+
+bool DiskWriter::service(DiskScratch &scratch) {
+  bool did_work = false;
+  while (true) {
+    if (not has_pending) {
+      has_pending = commands.pop(pending);
+    }
+
+    // Drain everything up to the next command (or everything, if there isn't
+    // one). Samples pushed while no file is open belong to no recording and
+    // are thrown away.
+    uint64_t target = has_pending ? pending.position : samples.written();
+    // Only ever pop whole frames, so they can be split into tracks
+    size_t max_block =
+        BLOCK_SIZE - BLOCK_SIZE % current.settings.num_channels;
+    while (samples.read() < target) {
+      size_t n = samples.pop(
+          scratch.block.data(),
+          std::min<uint64_t>(target - samples.read(), max_block));
+      write(scratch, n);
+      did_work = true;
+    }
+
+    if (not has_pending) {
+      return did_work;
+    }
+    close(scratch);
+    if (pending.type == Command::START) {
+      current = pending;
+      open(scratch);
+      writePreroll(scratch);
+    }
+    has_pending = false;
+    did_work = true;
+  }
+}
+
+void DiskWriter::write(DiskScratch &scratch, size_t n) {
+  if (files.empty()) {
+    return;
+  }
+  size_t frames = n / current.settings.num_channels;
+  if (resampler) {
+    resample(scratch, scratch.block.data(), frames, false);
+  } else {
+    writeFrames(scratch, scratch.block.data(), frames);
+  }
+}
+
+// Runs `n` frames through the resampler, writing out whatever it produces.
+// With `end_of_input` it also flushes out everything it still holds.
+void DiskWriter::resample(DiskScratch &scratch, const float *frames, size_t n,
+                          bool end_of_input) {
+  const TakeSettings &settings = current.settings;
+  SRC_DATA data;
+  data.data_in = frames;
+  data.input_frames = n;
+  data.end_of_input = end_of_input;
+  data.src_ratio = double(settings.output_rate) / settings.sample_rate;
+  do {
+    data.data_out = scratch.resampled.data();
+    data.output_frames = scratch.resampled.size() / settings.num_channels;
+    int error = src_process(resampler, &data);
+    if (error) {
+      printf("Resampling failed: %s\n", src_strerror(error));
+      return;
+    }
+    writeFrames(scratch, scratch.resampled.data(), data.output_frames_gen);
+    data.data_in += data.input_frames_used * settings.num_channels;
+    data.input_frames -= data.input_frames_used;
+  } while (data.input_frames > 0 or
+           (end_of_input and data.output_frames_gen > 0));
+}
+
+void DiskWriter::writeFrames(DiskScratch &scratch, const float *frames,
+                             size_t n) {
+  int num_channels = current.settings.num_channels;
+  if (files.size() == 1) {
+    writeSamples(scratch, 0, frames, n * num_channels);
+  } else {
+    // De-interleave one track at a time
+    for (size_t t = 0; t < files.size(); t++) {
+      for (size_t i = 0; i < n; i++) {
+        scratch.track[i] = frames[i * num_channels + t];
+      }
+      writeSamples(scratch, t, scratch.track.data(), n);
+    }
+  }
+  num_frames += n;
+  if (num_frames >= next_checkpoint) {
+    checkpoint();
+    next_checkpoint =
+        num_frames + CHECKPOINT_SECONDS * current.settings.output_rate;
+  }
+}
+
+// Makes everything written so far readable from the files on disk. FLAC
+// frames stand on their own, so those only need flushing.
+void DiskWriter::checkpoint() {
+  const TakeSettings &settings = current.settings;
+  int channels_per_file = settings.split ? 1 : settings.num_channels;
+  for (std::unique_ptr<Sink> &file : files) {
+    if (encoders.empty()) {
+      checkpointwav(*file, settings.format, channels_per_file, num_frames,
+                    settings.output_rate);
+    } else {
+      file->flush();
+    }
+  }
+}
+
+// Converts and writes `n` samples (interleaved, if the file has several
+// channels) to one of the take's files.
+void DiskWriter::writeSamples(DiskScratch &scratch, size_t file,
+                              const float *samples, size_t n) {
+  const TakeSettings &settings = current.settings;
+  Dither *d = settings.dither ? &dither : nullptr;
+  if (encoders.empty()) {
+    convert(settings.format, samples, scratch.bytes.data(), n, d);
+    files[file]->write(scratch.bytes.data(), sampleBytes(settings.format) * n);
+  } else {
+    // FLAC is encoded from 16 bit PCM
+    convert(SampleFmt::PCM_S16, samples, scratch.bytes.data(), n, d);
+    int channels_per_file = files.size() == 1 ? settings.num_channels : 1;
+    encoders[file]->write(reinterpret_cast<int16_t *>(scratch.bytes.data()),
+                          n / channels_per_file);
+  }
+}
+
+void DiskWriter::writePreroll(DiskScratch &scratch) {
+  const Preroll &preroll = current.preroll;
+  if (not preroll.busy) {
+    return;
+  }
+  // Gather the circular buffer into interleaved blocks
+  int num_channels = current.settings.num_channels;
+  size_t frames_per_block = scratch.block.size() / num_channels;
+  size_t done = 0;
+  while (done < preroll.count) {
+    size_t frames = std::min(preroll.count - done, frames_per_block);
+    for (size_t i = 0; i < frames; i++) {
+      size_t index = (preroll.first + done + i) % preroll.capacity;
+      const float *frame = preroll.frames + index * preroll.stride;
+      std::copy(frame, frame + num_channels,
+                &scratch.block[i * num_channels]);
+    }
+    write(scratch, frames * num_channels);
+    done += frames;
+  }
+  preroll.busy->store(false, std::memory_order_release);
+}
+
+void DiskWriter::open(DiskScratch &scratch) {
+  TakeSettings &settings = current.settings;
+  bool flac = settings.format == SampleFmt::FLAC_16;
+  if (flac and settings.num_channels > FLAC_MAX_CHANNELS and
+      not settings.split) {
+    printf("FLAC can't hold %d channels, splitting the take into tracks\n",
+           settings.num_channels);
+    settings.split = true;
+  }
+  const char *extension = flac ? ".flac" : ".wav";
+  // Interleaved and split takes share one numbering. The check only matters
+  // if something else has created recordings since the directory was scanned.
+  std::string base;
+  do {
+    base = "recording" + std::to_string(next_take_index());
+  } while (file_exists(base + ".wav") or file_exists(base + "-1.wav") or
+           file_exists(base + ".flac") or file_exists(base + "-1.flac"));
+
+  std::vector<std::string> filenames;
+  if (settings.split) {
+    for (int t = 1; t <= settings.num_channels; t++) {
+      filenames.push_back(base + "-" + std::to_string(t) + extension);
+    }
+  } else {
+    filenames.push_back(base + extension);
+  }
+
+  num_frames = 0;
+  next_checkpoint = CHECKPOINT_SECONDS * settings.output_rate;
+  int channels_per_file = settings.split ? 1 : settings.num_channels;
+  for (const std::string &filename : filenames) {
+    std::unique_ptr<Sink> file = createSink(settings.sink);
+    if (not file->open(filename.c_str())) {
+      printf("Couldn't open %s for writing\n", filename.c_str());
+      break;
+    }
+    if (flac) {
+      encoders.emplace_back(
+          new FlacEncoder(*file, channels_per_file, settings.output_rate));
+    } else {
+      // Placeholder header, rewritten with the real sizes on stop.
+      writeheader(*file, settings.format, channels_per_file, 0,
+                  settings.output_rate);
+    }
+    files.push_back(std::move(file));
+    printf("Recording to %s, %d channels %d (%d), %s\n", filename.c_str(),
+           channels_per_file, settings.sample_rate, settings.output_rate,
+           toString(settings.format));
+  }
+  if (files.size() != filenames.size()) {
+    // Tracks are identified by position, so don't write a partial set
+    close(scratch);
+    return;
+  }
+
+  if (settings.output_rate != settings.sample_rate) {
+    int error = 0;
+    resampler = src_new(settings.quality, settings.num_channels, &error);
+    if (not resampler) {
+      printf("Couldn't create resampler: %s\n", src_strerror(error));
+      close(scratch);
+    }
+  }
+}
+
+void DiskWriter::close(DiskScratch &scratch) {
+  const TakeSettings &settings = current.settings;
+  if (resampler) {
+    if (not files.empty()) {
+      resample(scratch, nullptr, 0, true);
+    }
+    resampler = src_delete(resampler);
+  }
+  int channels_per_file = settings.split ? 1 : settings.num_channels;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (encoders.empty()) {
+      finishwav(*files[i], settings.format, channels_per_file, num_frames,
+                settings.output_rate);
+    } else {
+      encoders[i]->finish();
+    }
+    files[i]->close();
+  }
+  encoders.clear();
+  files.clear();
+}
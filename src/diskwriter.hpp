@@ -0,0 +1,115 @@
+#pragma once
+
+#include "convert.hpp"
+#include "diskworker.hpp"
+#include "flacencoder.hpp"
+#include "ringbuffer.hpp"
+#include "sink.hpp"
+#include "wavwriter.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <samplerate.h>
+#include <vector>
+
+// Audio captured before a take started, to be spliced in at the start of the
+// file. The frames live in a circular buffer owned by the Recorder, which must
+// leave it alone until the writer clears `busy`.
+struct Preroll {
+  const float *frames = nullptr; // `capacity` frames of `stride` samples
+  size_t capacity = 0;
+  size_t stride = 0;
+  size_t first = 0; // index of the oldest frame
+  size_t count = 0;
+  std::atomic<bool> *busy = nullptr;
+};
+
+// Everything about a take that is fixed when it starts
+struct TakeSettings {
+  SampleFmt format = SampleFmt::FLOAT_32;
+  int num_channels = 1;
+  int sample_rate = 44100; // of the pushed samples
+  // Rate of the file. If it differs from `sample_rate` the writer thread
+  // resamples with libsamplerate, using `quality` as the converter type.
+  int output_rate = 44100;
+  int quality = SRC_SINC_MEDIUM_QUALITY;
+  bool dither = false; // TPDF dither for the integer formats
+  bool split = false;  // one mono file per channel
+  SinkType sink = SinkType::STDIO_SINK;
+};
+
+// Streams recorded audio to WAV (or FLAC) files.
+//
+// The audio thread calls start(), push() and stop(). None of these allocate or
+// touch the filesystem: samples go into a preallocated ring buffer, and
+// start/stop are queued as commands tagged with the ring position at which
+// they happened. The shared DiskWorker thread drains the ring in large blocks,
+// converts them to the output format and appends them to the file, opening
+// and closing files as it reaches each command. The headers are rewritten
+// every second of audio, so a crash mid-take still leaves a playable file.
+struct DiskWriter : DiskClient {
+  // `capacity` is the size of the sample ring, in samples (not frames).
+  explicit DiskWriter(size_t capacity);
+  ~DiskWriter();
+
+  // Detaches from the worker and finishes any recording still in progress on
+  // the calling thread. Call this before freeing a pre-roll that may still be
+  // in use. Nothing should be pushed afterwards.
+  void finish();
+
+  // Audio thread only
+  // The first `num_channels` samples of each `preroll` frame are written
+  // before anything pushed after this call. start() and stop() return false,
+  // and do nothing, if the writer thread hasn't taken enough of the earlier
+  // ones yet.
+  bool start(const TakeSettings &settings,
+             const Preroll &preroll = Preroll());
+  // Pushes `n` interleaved samples. Returns false (and drops them) if the
+  // writer thread has fallen too far behind.
+  bool push(const float *samples, size_t n);
+  bool stop();
+
+  // Number of samples dropped because the ring was full.
+  uint64_t overruns() const { return dropped.load(std::memory_order_relaxed); }
+
+  // Drains everything pushed so far and applies any queued commands
+  bool service(DiskScratch &scratch) override;
+
+private:
+  struct Command {
+    enum Type { START, STOP } type;
+    // The ring position (in samples) at which this command takes effect
+    uint64_t position;
+    TakeSettings settings;
+    Preroll preroll;
+  };
+
+  SPSCRing<float> samples;
+  SPSCRing<Command> commands;
+  std::atomic<uint64_t> dropped{0};
+  bool finished = false;
+
+  // Writer side. Only touched by the thread servicing this writer.
+  std::vector<std::unique_ptr<Sink>> files;
+  // One per file, for FLAC takes
+  std::vector<std::unique_ptr<FlacEncoder>> encoders;
+  Command current = {};
+  Command pending = {};
+  bool has_pending = false;
+  uint64_t num_frames = 0; // written to each file so far
+  uint64_t next_checkpoint = 0;
+  Dither dither;
+  SRC_STATE *resampler = nullptr;
+
+  void write(DiskScratch &scratch, size_t n);
+  void resample(DiskScratch &scratch, const float *frames, size_t n,
+                bool end_of_input);
+  void writeFrames(DiskScratch &scratch, const float *frames, size_t n);
+  void writeSamples(DiskScratch &scratch, size_t file, const float *samples,
+                    size_t n);
+  void checkpoint();
+  void writePreroll(DiskScratch &scratch);
+  void open(DiskScratch &scratch);
+  void close(DiskScratch &scratch);
+};
@@ -0,0 +1,369 @@
+#include "flacencoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+// Rice parameters are 4 bits, and 15 is reserved as an escape code
+#define MAX_RICE_PARAM 14
+#define MAX_PARTITION_ORDER 8
+
+namespace {
+
+struct CrcTables {
+  uint8_t crc8[256];
+  uint16_t crc16[256];
+  CrcTables() {
+    for (int i = 0; i < 256; i++) {
+      uint8_t c8 = i;
+      uint16_t c16 = i << 8;
+      for (int bit = 0; bit < 8; bit++) {
+        c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1;
+        c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1;
+      }
+      crc8[i] = c8;
+      crc16[i] = c16;
+    }
+  }
+};
+
+const CrcTables crc_tables;
+
+uint8_t crc8(const uint8_t *data, size_t n) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < n; i++) {
+    crc = crc_tables.crc8[crc ^ data[i]];
+  }
+  return crc;
+}
+
+uint16_t crc16(const uint8_t *data, size_t n) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < n; i++) {
+    crc = (crc << 8) ^ crc_tables.crc16[(crc >> 8) ^ data[i]];
+  }
+  return crc;
+}
+
+// Residual of the fixed predictor of the given order at x[i]
+inline int32_t fixed_residual(const int32_t *x, size_t i, int order) {
+  switch (order) {
+  case 0:
+    return x[i];
+  case 1:
+    return x[i] - x[i - 1];
+  case 2:
+    return x[i] - 2 * x[i - 1] + x[i - 2];
+  case 3:
+    return x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+  default:
+    return x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+  }
+}
+
+// Rice codes work on unsigned values: 0, -1, 1, -2, 2...
+inline uint32_t zigzag(int32_t x) { return (uint32_t(x) << 1) ^ (x >> 31); }
+
+} // namespace
+
+FlacEncoder::FlacEncoder(Sink &sink, int num_channels, int sample_rate,
+                         double budget)
+    : sink(sink), num_channels(num_channels), sample_rate(sample_rate),
+      budget(budget) {
+  for (int c = 0; c < num_channels; c++) {
+    block[c].resize(FLAC_BLOCK_SIZE);
+  }
+  if (num_channels == 2) {
+    mid.resize(FLAC_BLOCK_SIZE);
+    side.resize(FLAC_BLOCK_SIZE);
+  }
+  residual.resize(FLAC_BLOCK_SIZE);
+  // Worst case is a verbatim frame, plus room for the headers
+  bytes.reserve(num_channels * FLAC_BLOCK_SIZE * 3 + 64);
+  makeStreamInfo();
+  sink.write(bytes.data(), bytes.size());
+}
+
+void FlacEncoder::write(const int16_t *frames, size_t n) {
+  while (n > 0) {
+    size_t take = std::min(n, FLAC_BLOCK_SIZE - block_fill);
+    for (size_t i = 0; i < take; i++) {
+      for (int c = 0; c < num_channels; c++) {
+        block[c][block_fill + i] = frames[i * num_channels + c];
+      }
+    }
+    block_fill += take;
+    frames += take * num_channels;
+    n -= take;
+    if (block_fill == FLAC_BLOCK_SIZE) {
+      encodeBlock();
+    }
+  }
+}
+
+void FlacEncoder::finish() {
+  if (block_fill > 0) {
+    encodeBlock();
+  }
+  makeStreamInfo();
+  sink.rewrite(0, bytes.data(), bytes.size());
+}
+
+void FlacEncoder::makeStreamInfo() {
+  bytes.clear();
+  put(0x664C6143, 32);                            /* "fLaC"            */
+  put(0x80, 8);                                   /* last, STREAMINFO  */
+  put(34, 24);                                    /* block length      */
+  put(FLAC_BLOCK_SIZE, 16);                       /* min block size    */
+  put(FLAC_BLOCK_SIZE, 16);                       /* max block size    */
+  put(max_frame_bytes ? min_frame_bytes : 0, 24); /* min frame size    */
+  put(max_frame_bytes, 24);                       /* max frame size    */
+  put(sample_rate, 20);                           /* sample rate       */
+  put(num_channels - 1, 3);                       /* # of channels - 1 */
+  put(16 - 1, 5);                                 /* bits per sample-1 */
+  put(total_frames >> 32, 4);                     /* # of frames, 36   */
+  put(total_frames & 0xFFFFFFFF, 32);             /* bits in total     */
+  for (int i = 0; i < 4; i++) {
+    put(0, 32); /* MD5, zero for unknown */
+  }
+}
+
+// Picks the predictor order and Rice partitioning for one channel of a block,
+// and fills in the size in bits the subframe would have.
+void FlacEncoder::choose(const int32_t *x, size_t n, int bps,
+                         Choice &choice) {
+  choice.verbatim = true;
+  choice.order = 0;
+  choice.partition_order = 0;
+  choice.bits = 8 + uint64_t(n) * bps;
+
+  // Fixed predictors: the order with the smallest sum of residuals wins
+  int max = std::min<int>(max_order, n > 4 ? 4 : n - 1);
+  uint64_t best_sum = UINT64_MAX;
+  int order = 0;
+  for (int o = 0; o <= max; o++) {
+    uint64_t sum = 0;
+    for (size_t i = max; i < n; i++) {
+      sum += std::abs(fixed_residual(x, i, o));
+    }
+    if (sum < best_sum) {
+      best_sum = sum;
+      order = o;
+    }
+  }
+  for (size_t i = order; i < n; i++) {
+    residual[i] = fixed_residual(x, i, order);
+  }
+
+  // Sums of the residuals over the finest partitioning, merged pairwise for
+  // each coarser one
+  int max_po = 0;
+  while (max_po < max_partition_order and (n % (2u << max_po)) == 0 and
+         (n >> (max_po + 1)) > size_t(order)) {
+    max_po++;
+  }
+  uint64_t sums[1 << MAX_PARTITION_ORDER];
+  size_t part = n >> max_po;
+  for (int p = 0; p < (1 << max_po); p++) {
+    uint64_t sum = 0;
+    for (size_t i = std::max(p * part, size_t(order)); i < (p + 1) * part;
+         i++) {
+      sum += zigzag(residual[i]);
+    }
+    sums[p] = sum;
+  }
+
+  for (int po = max_po; po >= 0; po--) {
+    if (po < max_po) {
+      for (int p = 0; p < (1 << po); p++) {
+        sums[p] = sums[2 * p] + sums[2 * p + 1];
+      }
+    }
+    uint64_t bits = 8 + uint64_t(order) * bps + 2 + 4;
+    int params[1 << MAX_PARTITION_ORDER];
+    for (int p = 0; p < (1 << po); p++) {
+      size_t count = (n >> po) - (p == 0 ? order : 0);
+      // Estimated cost of each parameter: a unary quotient and k low bits
+      uint64_t best = UINT64_MAX;
+      for (int k = 0; k <= MAX_RICE_PARAM; k++) {
+        uint64_t cost = count * (k + 1) + (sums[p] >> k);
+        if (cost < best) {
+          best = cost;
+          params[p] = k;
+        }
+      }
+      bits += 4 + best;
+    }
+    if (bits < choice.bits) {
+      choice.bits = bits;
+      choice.verbatim = false;
+      choice.order = order;
+      choice.partition_order = po;
+      std::copy(params, params + (1 << po), choice.params);
+    }
+  }
+}
+
+void FlacEncoder::encodeSubframe(const int32_t *x, size_t n, int bps,
+                                 const Choice &choice) {
+  bool constant = true;
+  for (size_t i = 1; i < n and constant; i++) {
+    constant = x[i] == x[0];
+  }
+  if (constant) {
+    put(0x00, 8); /* CONSTANT */
+    putSigned(x[0], bps);
+    return;
+  }
+  if (choice.verbatim) {
+    put(0x02, 8); /* VERBATIM */
+    for (size_t i = 0; i < n; i++) {
+      putSigned(x[i], bps);
+    }
+    return;
+  }
+
+  put(0x10 | (choice.order << 1), 8); /* FIXED, order */
+  for (int i = 0; i < choice.order; i++) {
+    putSigned(x[i], bps); /* warmup */
+  }
+  put(0, 2);                      /* Rice, 4 bit parameters */
+  put(choice.partition_order, 4); /* partition order */
+  size_t part = n >> choice.partition_order;
+  for (int p = 0; p < (1 << choice.partition_order); p++) {
+    int k = choice.params[p];
+    put(k, 4);
+    for (size_t i = std::max(p * part, size_t(choice.order));
+         i < (p + 1) * part; i++) {
+      putRice(fixed_residual(x, i, choice.order), k);
+    }
+  }
+}
+
+void FlacEncoder::encodeBlock() {
+  auto start = std::chrono::steady_clock::now();
+  size_t n = block_fill;
+
+  // Work out the channel assignment. Stereo can be coded as any pair of
+  // left, right, mid and side, side needing one more bit.
+  const int32_t *channels[FLAC_MAX_CHANNELS];
+  int bps[FLAC_MAX_CHANNELS];
+  Choice choices[FLAC_MAX_CHANNELS];
+  int assignment = num_channels - 1; // independent
+  for (int c = 0; c < num_channels; c++) {
+    channels[c] = block[c].data();
+    bps[c] = 16;
+    choose(channels[c], n, bps[c], choices[c]);
+  }
+  if (num_channels == 2) {
+    for (size_t i = 0; i < n; i++) {
+      mid[i] = (block[0][i] + block[1][i]) >> 1;
+      side[i] = block[0][i] - block[1][i];
+    }
+    Choice mid_choice, side_choice;
+    choose(mid.data(), n, 16, mid_choice);
+    choose(side.data(), n, 17, side_choice);
+    uint64_t left_right = choices[0].bits + choices[1].bits;
+    uint64_t left_side = choices[0].bits + side_choice.bits;
+    uint64_t right_side = choices[1].bits + side_choice.bits;
+    uint64_t mid_side = mid_choice.bits + side_choice.bits;
+    uint64_t best = std::min(std::min(left_right, left_side),
+                             std::min(right_side, mid_side));
+    if (best == mid_side) {
+      assignment = 10;
+      channels[0] = mid.data(), choices[0] = mid_choice;
+      channels[1] = side.data(), choices[1] = side_choice, bps[1] = 17;
+    } else if (best == left_side) {
+      assignment = 8;
+      channels[1] = side.data(), choices[1] = side_choice, bps[1] = 17;
+    } else if (best == right_side) {
+      assignment = 9;
+      channels[0] = side.data(), choices[0] = side_choice, bps[0] = 17;
+    }
+  }
+
+  bytes.clear();
+  acc_bits = 0;
+  put(0xFFF8, 16);    /* sync, fixed block size */
+  put(7, 4);          /* block size: 16 bits at end of header */
+  put(0, 4);          /* sample rate: see STREAMINFO */
+  put(assignment, 4); /* channel assignment */
+  put(4, 3);          /* 16 bits per sample */
+  put(0, 1);          /* reserved */
+  // Frame number, UTF-8 style
+  uint32_t number = frame_number++;
+  if (number < 0x80) {
+    put(number, 8);
+  } else {
+    int extra = 1;
+    while (extra < 5 and number >= (1u << (5 * extra + 6))) {
+      extra++;
+    }
+    // extra + 1 leading ones, then the top bits of the number
+    uint32_t lead = (0xFF00 >> (extra + 1)) & 0xFF;
+    put(lead | (number >> (6 * extra)), 8);
+    for (int i = extra - 1; i >= 0; i--) {
+      put(0x80 | ((number >> (6 * i)) & 0x3F), 8);
+    }
+  }
+  put(n - 1, 16); /* block size - 1 */
+  put(crc8(bytes.data(), bytes.size()), 8);
+
+  for (int c = 0; c < num_channels; c++) {
+    encodeSubframe(channels[c], n, bps[c], choices[c]);
+  }
+  alignByte();
+  put(crc16(bytes.data(), bytes.size()), 16);
+  sink.write(bytes.data(), bytes.size());
+
+  min_frame_bytes = std::min<int>(min_frame_bytes, bytes.size());
+  max_frame_bytes = std::max<int>(max_frame_bytes, bytes.size());
+  total_frames += n;
+  block_fill = 0;
+
+  // Keep the effort within budget: back off the partition search first, then
+  // the predictor search.
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  double allowed = budget * n / sample_rate;
+  if (elapsed > allowed) {
+    if (max_partition_order > 0) {
+      max_partition_order--;
+    } else if (max_order > 1) {
+      max_order--;
+    }
+  } else if (elapsed < allowed / 4) {
+    if (max_order < 4) {
+      max_order++;
+    } else if (max_partition_order < 6) {
+      max_partition_order++;
+    }
+  }
+}
+
+void FlacEncoder::put(uint64_t value, int bits) {
+  acc = (acc << bits) | value;
+  acc_bits += bits;
+  while (acc_bits >= 8) {
+    acc_bits -= 8;
+    bytes.push_back(uint8_t(acc >> acc_bits));
+  }
+}
+
+void FlacEncoder::putRice(int32_t value, int k) {
+  uint32_t u = zigzag(value);
+  uint32_t q = u >> k;
+  while (q >= 32) {
+    put(0, 32);
+    q -= 32;
+  }
+  put(1, q + 1); /* q zeros, then a one */
+  put(u & ((uint32_t(1) << k) - 1), k);
+}
+
+void FlacEncoder::alignByte() {
+  if (acc_bits > 0) {
+    put(0, 8 - acc_bits);
+  }
+}
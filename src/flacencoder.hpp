@@ -0,0 +1,87 @@
+#pragma once
+
+#include "sink.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// FLAC can't describe more channels than this in one stream
+#define FLAC_MAX_CHANNELS 8
+// Frames per FLAC block
+#define FLAC_BLOCK_SIZE 4096
+
+// A small streaming FLAC encoder for 16 bit audio. Each block is encoded with
+// the best of FLAC's fixed polynomial predictors (orders 0 to 4) and
+// partitioned Rice coding, and stereo blocks also try the left/side,
+// right/side and mid/side decorrelations.
+//
+// The cost of a block is bounded by its length and the search effort (how
+// many predictor orders and partition orders are tried). The effort adapts so
+// that encoding a block stays under a given share of its duration in real
+// time, so the encoder can never fall behind the audio it is given.
+//
+// Runs on the disk writer thread. The buffers are allocated up front.
+struct FlacEncoder {
+  // Writes the stream header to `sink`. `budget` is the share of real time
+  // one block may take to encode.
+  FlacEncoder(Sink &sink, int num_channels, int sample_rate,
+              double budget = 0.1);
+
+  // Encodes `n` interleaved frames, buffering up to a full block.
+  void write(const int16_t *frames, size_t n);
+  // Encodes whatever is buffered and rewrites the header with the total
+  // length. Doesn't close the sink.
+  void finish();
+
+  uint64_t totalFrames() const { return total_frames; }
+  int effort() const { return max_order; }
+
+private:
+  Sink &sink;
+  int num_channels;
+  int sample_rate;
+  double budget;
+  uint64_t total_frames = 0;
+  uint32_t frame_number = 0;
+  int min_frame_bytes = 0xFFFFFF;
+  int max_frame_bytes = 0;
+
+  // Search effort, lowered when a block goes over budget
+  int max_order = 4;
+  int max_partition_order = 6;
+
+  // Planar samples of the block being filled, 32 bits so side channels fit
+  std::vector<int32_t> block[FLAC_MAX_CHANNELS];
+  // Mid and side, for stereo
+  std::vector<int32_t> mid, side;
+  std::vector<int32_t> residual;
+  size_t block_fill = 0;
+
+  // Bit writer for the current frame
+  std::vector<uint8_t> bytes;
+  uint64_t acc = 0;
+  int acc_bits = 0;
+
+  struct Choice {
+    int order;
+    int partition_order;
+    int params[1 << 8];
+    uint64_t bits; // size of the whole subframe
+    bool verbatim;
+  };
+
+  void encodeBlock();
+  // Fills `bytes` with the stream header
+  void makeStreamInfo();
+  void choose(const int32_t *x, size_t n, int bps, Choice &choice);
+  void encodeSubframe(const int32_t *x, size_t n, int bps,
+                      const Choice &choice);
+
+  void put(uint64_t value, int bits);
+  void putSigned(int64_t value, int bits) {
+    put(uint64_t(value) & ((uint64_t(1) << bits) - 1), bits);
+  }
+  void putRice(int32_t value, int k);
+  void alignByte();
+};
@@ -0,0 +1,90 @@
+#include "meter.hpp"
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define METER_X86 1
+#include <immintrin.h>
+#endif
+
+// How fast the held peaks fall, in dB per second
+#define PEAK_FALLOFF 20.0f
+// Time constant of the RMS average, in seconds
+#define RMS_TIME 0.3f
+
+Meter::Meter(int max_channels)
+    : max_channels(max_channels), stride((max_channels + 3) / 4 * 4),
+      block(METER_BLOCK * stride) {
+  setSampleRate(44100);
+}
+
+void Meter::setSampleRate(float sample_rate) {
+  float block_time = METER_BLOCK / sample_rate;
+  peak_decay = powf(10.0f, -PEAK_FALLOFF * block_time / 20.0f);
+  rms_coefficient = 1.0f - expf(-block_time / RMS_TIME);
+}
+
+void Meter::resetClips() {
+  std::fill(current.clips, current.clips + METER_MAX_CHANNELS, 0);
+}
+
+void Meter::process() {
+  float block_peak[METER_MAX_CHANNELS];
+  float block_sum[METER_MAX_CHANNELS];
+  uint32_t block_clips[METER_MAX_CHANNELS];
+#ifdef METER_X86
+  // The channels of a frame are next to each other, so each vector holds the
+  // same four channels all the way down the block. Going across the frame in
+  // the inner loop keeps several independent accumulators in flight.
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  const __m128 clip = _mm_set1_ps(METER_CLIP_VOLTAGE);
+  const int vectors = stride / 4;
+  __m128 peak[METER_MAX_CHANNELS / 4], sum[METER_MAX_CHANNELS / 4];
+  __m128i clips[METER_MAX_CHANNELS / 4];
+  for (int v = 0; v < vectors; v++) {
+    peak[v] = sum[v] = _mm_setzero_ps();
+    clips[v] = _mm_setzero_si128();
+  }
+  for (int i = 0; i < METER_BLOCK; i++) {
+    const float *frame = &block[i * stride];
+    for (int v = 0; v < vectors; v++) {
+      __m128 x = _mm_loadu_ps(frame + 4 * v);
+      __m128 a = _mm_andnot_ps(sign, x);
+      peak[v] = _mm_max_ps(peak[v], a);
+      sum[v] = _mm_add_ps(sum[v], _mm_mul_ps(x, x));
+      // The comparison is all ones (-1) in the lanes that clipped
+      clips[v] =
+          _mm_sub_epi32(clips[v], _mm_castps_si128(_mm_cmpge_ps(a, clip)));
+    }
+  }
+  for (int v = 0; v < vectors; v++) {
+    _mm_storeu_ps(block_peak + 4 * v, peak[v]);
+    _mm_storeu_ps(block_sum + 4 * v, sum[v]);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(block_clips + 4 * v),
+                     clips[v]);
+  }
+#else
+  for (int c = 0; c < max_channels; c++) {
+    block_peak[c] = block_sum[c] = 0;
+    block_clips[c] = 0;
+    for (int i = 0; i < METER_BLOCK; i++) {
+      float x = block[i * stride + c];
+      block_peak[c] = std::max(block_peak[c], std::fabs(x));
+      block_sum[c] += x * x;
+      block_clips[c] += std::fabs(x) >= METER_CLIP_VOLTAGE;
+    }
+  }
+#endif
+
+  for (int c = 0; c < max_channels; c++) {
+    current.peak[c] = std::max(block_peak[c], current.peak[c] * peak_decay);
+    mean_square[c] +=
+        (block_sum[c] / METER_BLOCK - mean_square[c]) * rms_coefficient;
+    current.rms[c] = sqrtf(mean_square[c]);
+    current.clips[c] += block_clips[c];
+  }
+  current.num_channels = channels;
+  snapshots.write() = current;
+  snapshots.publish();
+  fill = 0;
+}
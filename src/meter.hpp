@@ -0,0 +1,63 @@
+#pragma once
+
+#include "snapshot.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Most channels a Meter can measure
+#define METER_MAX_CHANNELS 16
+// Frames analysed at once
+#define METER_BLOCK 64
+// Level at which the files clip: full scale is +-12V
+#define METER_CLIP_VOLTAGE 12.0f
+
+// What the meters show, in volts
+struct MeterLevels {
+  int num_channels = 0;
+  float peak[METER_MAX_CHANNELS] = {}; // held, then falling off
+  float rms[METER_MAX_CHANNELS] = {};  // over about 300ms
+  uint32_t clips[METER_MAX_CHANNELS] = {}; // samples at or past full scale
+};
+
+// Peak, RMS and clip metering of a stream of frames.
+//
+// The audio thread pushes every frame. They are collected into blocks, and
+// each block is analysed with SIMD, four channels at a time. The levels are
+// then published once per block through a triple buffer, so the UI thread
+// reads them without locks and the audio thread only does per-block work
+// apart from copying the frame.
+struct Meter {
+  explicit Meter(int max_channels);
+
+  // Audio thread
+  void setSampleRate(float sample_rate);
+  // `frame` has `max_channels` samples, of which the first `num_channels` are
+  // measured.
+  void push(const float *frame, int num_channels) {
+    std::copy(frame, frame + max_channels, &block[fill * stride]);
+    channels = num_channels;
+    if (++fill == METER_BLOCK) {
+      process();
+    }
+  }
+  void resetClips();
+
+  // UI thread
+  const MeterLevels &levels() { return snapshots.read(); }
+
+private:
+  const int max_channels;
+  const int stride; // `max_channels` rounded up to whole vectors
+  std::vector<float> block;
+  int fill = 0;
+  int channels = 0;
+  float peak_decay = 0;
+  float rms_coefficient = 0;
+  float mean_square[METER_MAX_CHANNELS] = {};
+  MeterLevels current;
+  TripleBuffer<MeterLevels> snapshots;
+
+  void process();
+};
@@ -0,0 +1,120 @@
+#include "minblep.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+typedef std::complex<double> Complex;
+
+// In place radix-2 FFT. `x.size()` must be a power of two. The inverse isn't
+// scaled.
+static void fft(std::vector<Complex> &x, bool inverse) {
+  size_t n = x.size();
+  for (size_t i = 1, j = 0; i < n; i++) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      std::swap(x[i], x[j]);
+    }
+  }
+  for (size_t len = 2; len <= n; len <<= 1) {
+    double angle = (inverse ? 2 : -2) * M_PI / len;
+    Complex w_len(cos(angle), sin(angle));
+    for (size_t i = 0; i < n; i += len) {
+      Complex w(1);
+      for (size_t k = 0; k < len / 2; k++) {
+        Complex a = x[i + k], b = x[i + k + len / 2] * w;
+        x[i + k] = a + b;
+        x[i + k + len / 2] = a - b;
+        w *= w_len;
+      }
+    }
+  }
+}
+
+static void ifft(std::vector<Complex> &x) {
+  fft(x, true);
+  for (Complex &v : x) {
+    v /= double(x.size());
+  }
+}
+
+// A windowed sinc, made minimum phase through its real cepstrum, then
+// integrated into a step. See Brandt, "Hard Sync Without Aliasing" (2001).
+static std::vector<float> makeTable() {
+  const int z = MINBLEP_ZERO_CROSSINGS, o = MINBLEP_OVERSAMPLE;
+  const int n = 2 * z * o;
+  std::vector<Complex> x(n);
+  for (int i = 0; i < n; i++) {
+    double p = -z + 2.0 * z * i / (n - 1);
+    double sinc = p == 0 ? 1 : sin(M_PI * p) / (M_PI * p);
+    // Blackman-Harris window
+    double t = 2 * M_PI * i / (n - 1);
+    double window = 0.35875 - 0.48829 * cos(t) + 0.14128 * cos(2 * t) -
+                    0.01168 * cos(3 * t);
+    x[i] = sinc * window;
+  }
+
+  // Real cepstrum
+  fft(x, false);
+  for (Complex &v : x) {
+    v = log(std::max(std::abs(v), 1e-100));
+  }
+  ifft(x);
+  // Fold the negative quefrencies onto the positive ones
+  for (int i = 1; i < n / 2; i++) {
+    x[i] *= 2;
+  }
+  for (int i = n / 2 + 1; i < n; i++) {
+    x[i] = 0;
+  }
+  fft(x, false);
+  for (Complex &v : x) {
+    v = exp(v);
+  }
+  ifft(x);
+
+  // Integrate the impulse into a step, and make it end at exactly 1
+  std::vector<float> table(n + 1);
+  double total = 0;
+  std::vector<double> step(n);
+  for (int i = 0; i < n; i++) {
+    total += x[i].real();
+    step[i] = total;
+  }
+  for (int i = 0; i < n; i++) {
+    table[i] = step[i] / total;
+  }
+  table[n] = 1.0f;
+  return table;
+}
+
+const float *minblepTable() {
+  static const std::vector<float> table = makeTable();
+  return table.data();
+}
+
+void MinBlep::reset() {
+  std::fill(buf, buf + LENGTH, 0.0f);
+  pos = 0;
+}
+
+void MinBlep::jump(float p, float dx) {
+  if (p <= -1.0f or p > 0.0f) {
+    return;
+  }
+  // Frame j reads the table at (j - p) * MINBLEP_OVERSAMPLE, so the
+  // interpolation is the same for every frame
+  float index = -p * MINBLEP_OVERSAMPLE;
+  int start = int(index);
+  float frac = index - start;
+  for (int j = 0; j < LENGTH; j++) {
+    const float *t = &table[j * MINBLEP_OVERSAMPLE + start];
+    float step = t[0] + frac * (t[1] - t[0]);
+    buf[(pos + j) & (LENGTH - 1)] += dx * (step - 1.0f);
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// Zero crossings of the sinc on each side of a step
+#define MINBLEP_ZERO_CROSSINGS 16
+// Table points per frame
+#define MINBLEP_OVERSAMPLE 32
+
+// The minimum phase band limited step (minBLEP): a step from 0 to 1 without
+// the harmonics above Nyquist, over 2 * MINBLEP_ZERO_CROSSINGS frames. The
+// table has 2 * MINBLEP_ZERO_CROSSINGS * MINBLEP_OVERSAMPLE + 1 points. It is
+// computed the first time it is asked for, which takes a few milliseconds, so
+// do that off the audio thread (MinBlep's constructor does).
+const float *minblepTable();
+
+// Turns the hard steps of a signal into band limited ones. Add shift() to the
+// signal every frame, and call jump() whenever the signal steps.
+//
+// This is the same technique as Rack's dsp/minblep.hpp, but with no
+// dependency on Rack, so the DSP using it can also run offline.
+struct MinBlep {
+  MinBlep() : table(minblepTable()) {}
+  void reset();
+
+  // Places a step of `dx` at `p` frames from the current one, with
+  // -1 < p <= 0. The signal is expected to have already stepped.
+  void jump(float p, float dx);
+
+  // The correction for the current frame, moving on to the next
+  float shift() {
+    float v = buf[pos];
+    buf[pos] = 0.0f;
+    pos = (pos + 1) & (LENGTH - 1);
+    return v;
+  }
+
+private:
+  static const int LENGTH = 2 * MINBLEP_ZERO_CROSSINGS;
+  const float *table;
+  float buf[LENGTH] = {};
+  int pos = 0;
+};
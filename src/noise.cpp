@@ -0,0 +1,217 @@
+#include "noise.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_X86 1
+#include <xmmintrin.h>
+#endif
+
+// Kellet's filter bank: every stage is b = pole * b + gain * white
+static const float LOW_POLES[4] = {0.99886f, 0.99332f, 0.96900f, 0.86650f};
+static const float LOW_GAINS[4] = {0.0555179f, 0.0750759f, 0.1538520f,
+                                   0.3104856f};
+static const float HIGH_POLES[4] = {0.55000f, -0.7616f, 0, 0};
+static const float HIGH_GAINS[4] = {0.5329522f, -0.0168980f, 0, 0};
+// Plus the white noise itself and its previous sample
+static const float DIRECT_GAIN = 0.5362f;
+static const float DELAYED_GAIN = 0.115926f;
+
+// Bring each colour to an RMS of 1/3 of the +-1 range. Measured with uniform
+// white noise over +-1.
+static const float PINK_SCALE = 0.188f;
+static const float BLUE_SCALE = 0.318f;
+static const float VIOLET_SCALE = 0.408f;
+
+static inline float bipolar(float u) { return 2.0f * u - 1.0f; }
+
+// From +-1 (clipping anything beyond) back to [0, 1]
+static inline float unipolar(float x) {
+  x = x < -1.0f ? -1.0f : (x > 1.0f ? 1.0f : x);
+  return 0.5f + 0.5f * x;
+}
+
+void NoiseColourFilter::reset() {
+  for (int i = 0; i < 4; i++) {
+    low[i] = high[i] = 0;
+  }
+  last_white = last_pink = last_violet_white = 0;
+}
+
+void NoiseColourFilter::kellet(const float *white, float *out, size_t n) {
+#ifdef NOISE_X86
+  __m128 b_low = _mm_load_ps(low), b_high = _mm_load_ps(high);
+  const __m128 low_poles = _mm_loadu_ps(LOW_POLES);
+  const __m128 low_gains = _mm_loadu_ps(LOW_GAINS);
+  const __m128 high_poles = _mm_loadu_ps(HIGH_POLES);
+  const __m128 high_gains = _mm_loadu_ps(HIGH_GAINS);
+  float last = last_white;
+  for (size_t i = 0; i < n; i++) {
+    float w = bipolar(white[i]);
+    __m128 wv = _mm_set1_ps(w);
+    b_low = _mm_add_ps(_mm_mul_ps(b_low, low_poles), _mm_mul_ps(wv, low_gains));
+    b_high =
+        _mm_add_ps(_mm_mul_ps(b_high, high_poles), _mm_mul_ps(wv, high_gains));
+    __m128 sum = _mm_add_ps(b_low, b_high);
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    out[i] = _mm_cvtss_f32(sum) + DIRECT_GAIN * w + DELAYED_GAIN * last;
+    last = w;
+  }
+  _mm_store_ps(low, b_low);
+  _mm_store_ps(high, b_high);
+  last_white = last;
+#else
+  for (size_t i = 0; i < n; i++) {
+    float w = bipolar(white[i]);
+    float sum = DIRECT_GAIN * w + DELAYED_GAIN * last_white;
+    for (int k = 0; k < 4; k++) {
+      low[k] = LOW_POLES[k] * low[k] + LOW_GAINS[k] * w;
+      high[k] = HIGH_POLES[k] * high[k] + HIGH_GAINS[k] * w;
+      sum += low[k] + high[k];
+    }
+    out[i] = sum;
+    last_white = w;
+  }
+#endif
+}
+
+void NoiseColourFilter::pink(const float *white, float *out, size_t n) {
+  kellet(white, out, n);
+  for (size_t i = 0; i < n; i++) {
+    out[i] = unipolar(PINK_SCALE * out[i]);
+  }
+}
+
+// The state is kept in locals in the loops below: `out` could alias the
+// members as far as the compiler knows, which would stop it from keeping them
+// in registers.
+
+void NoiseColourFilter::blue(const float *white, float *out, size_t n) {
+  kellet(white, out, n);
+  float last = last_pink;
+  for (size_t i = 0; i < n; i++) {
+    float pink = out[i];
+    out[i] = unipolar(BLUE_SCALE * (pink - last));
+    last = pink;
+  }
+  last_pink = last;
+}
+
+void NoiseColourFilter::violet(const float *white, float *out, size_t n) {
+  float last = last_violet_white;
+  for (size_t i = 0; i < n; i++) {
+    float w = bipolar(white[i]);
+    out[i] = unipolar(VIOLET_SCALE * (w - last));
+    last = w;
+  }
+  last_violet_white = last;
+}
+
+void NoiseSource::reset() {
+  colour.reset();
+  block_type = NoiseType::WHITE_NOISE;
+  pos = NOISE_BLOCK;
+}
+
+void NoiseSource::fill(Random &random, NoiseType type) {
+  random.fill(block, NOISE_BLOCK);
+  switch (type) {
+  case NoiseType::PINK_NOISE:
+    colour.pink(block, block, NOISE_BLOCK);
+    break;
+  case NoiseType::BLUE_NOISE:
+    colour.blue(block, block, NOISE_BLOCK);
+    break;
+  case NoiseType::VIOLET_NOISE:
+    colour.violet(block, block, NOISE_BLOCK);
+    break;
+  default:
+    break;
+  }
+  block_type = type;
+  pos = 0;
+}
+
+void NoiseVoice::reset() {
+  source.reset();
+  blep.reset();
+  phase = 0.0f;
+  held = 0.0f;
+  next = -1.0f;
+  pulse = 0.0f;
+}
+
+void NoiseVoice::process(Random &random, NoiseType type, float delta,
+                         float volume, float width, float *out, int n) {
+  switch (type) {
+  case NoiseType::WHITE_NOISE:
+  default:
+    run<NoiseType::WHITE_NOISE>(random, delta, volume, width, out, n);
+    break;
+  case NoiseType::BROWNIAN:
+    run<NoiseType::BROWNIAN>(random, delta, volume, width, out, n);
+    break;
+  case NoiseType::TRIGGER:
+    run<NoiseType::TRIGGER>(random, delta, volume, width, out, n);
+    break;
+  case NoiseType::PINK_NOISE:
+    run<NoiseType::PINK_NOISE>(random, delta, volume, width, out, n);
+    break;
+  case NoiseType::BLUE_NOISE:
+    run<NoiseType::BLUE_NOISE>(random, delta, volume, width, out, n);
+    break;
+  case NoiseType::VIOLET_NOISE:
+    run<NoiseType::VIOLET_NOISE>(random, delta, volume, width, out, n);
+    break;
+  case NoiseType::POISSON_TRIGGER:
+    run<NoiseType::POISSON_TRIGGER>(random, delta, volume, width, out, n);
+    break;
+  }
+}
+
+template <NoiseType TYPE>
+void NoiseVoice::run(Random &random, float delta, float volume, float width,
+                     float *out, int n) {
+  for (int i = 0; i < n; i++) {
+    if (TYPE == NoiseType::POISSON_TRIGGER) {
+      out[i] = poisson(random, delta, volume, width);
+      continue;
+    }
+    phase += delta;
+    if (phase >= 1.0f) {
+      step<TYPE>(random, delta, volume);
+    }
+    out[i] = held + blep.shift();
+  }
+}
+
+template <NoiseType TYPE>
+void NoiseVoice::step(Random &random, float delta, float volume) {
+  // Periods shorter than a frame just skip samples
+  phase -= floorf(phase);
+  // Any Poisson event drawn is stale by the time that mode is back
+  next = -1.0f;
+  float previous = held;
+  held = source.next<TYPE>(random, held, volume);
+  // The new sample started `phase / delta` frames ago. Triggers keep their
+  // hard edges, since they drive other modules' trigger inputs.
+  if (TYPE != NoiseType::TRIGGER) {
+    blep.jump(-phase / delta, held - previous);
+  }
+}
+
+float poissonEvent(Random &random, float &phase, float &next, float delta,
+                   float width, float pulse) {
+  // The event happened this many frames ago. Every pulse is at least a frame
+  // long, and events during a pulse extend it.
+  float late = (phase - next) / delta;
+  pulse = std::max(pulse, std::max(width - late, 1.0f));
+  // Events closer together than a frame merge into one
+  do {
+    phase -= next;
+    next = exponential(random);
+  } while (phase >= next);
+  return pulse;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "minblep.hpp"
+#include "random.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Noise samples generated at once
+#define NOISE_BLOCK 64
+// The period knobs count frames at this rate, which is what they counted
+// before the period was independent of the engine's sample rate
+#define PERIOD_REFERENCE_RATE 44100.0f
+// The shortest and longest POISSON_TRIGGER pulses, in seconds. The shortest
+// is as long as Rack's triggers.
+#define POISSON_MIN_WIDTH 0.001f
+#define POISSON_MAX_WIDTH 1.0f
+
+// The kinds of noise the noise modules make. These are saved in patches, so
+// new ones go at the end.
+enum NoiseType {
+  WHITE_NOISE,
+  BROWNIAN,
+  TRIGGER,
+  PINK_NOISE,
+  BLUE_NOISE,
+  VIOLET_NOISE,
+  // Triggers at random times, on average one per period (see NoiseVoice)
+  POISSON_TRIGGER,
+};
+
+// Filters that colour white noise, a block at a time. They take uniform white
+// noise in [0, 1) (as from Random::fill()) and return noise in [0, 1], centred
+// on 0.5, so they can work in place and the result is a drop-in replacement
+// for the white noise. Each colour is scaled to a third of the range RMS, so
+// that peaks rarely reach the ends, where it is clipped.
+//
+// Pink noise uses Paul Kellet's refined filter bank (accurate to +-0.05dB
+// above 9.2Hz at 44.1kHz). The one-pole stages are independent of each
+// other, so they are run side by side in SSE registers. Blue and violet noise
+// are the first differences of pink and white noise.
+struct NoiseColourFilter {
+  NoiseColourFilter() { reset(); }
+  void reset();
+
+  // -3dB per octave
+  void pink(const float *white, float *out, size_t n);
+  // +3dB per octave
+  void blue(const float *white, float *out, size_t n);
+  // +6dB per octave
+  void violet(const float *white, float *out, size_t n);
+
+private:
+  // Kellet's b0-b3 and b4-b5, the latter padded with zeros
+  alignas(16) float low[4];
+  alignas(16) float high[4];
+  float last_white; // Kellet's b6 comes from the previous sample
+  float last_pink;  // for blue noise
+  float last_violet_white;
+
+  // Unscaled pink noise from bipolar white noise
+  void kellet(const float *white, float *out, size_t n);
+};
+
+// The knob and CV inputs are from 0V to 10V. (note that negative CV inputs
+// will still work) We then multiply the knob and CV inputs by 10V to obtain a
+// nicer distribution of values. This way, clock length can range from 1 to
+// 1000 instead of just 1 to 10. The multiplier switch will increase the range
+// from 1 to 100,000. The lengths are in frames at PERIOD_REFERENCE_RATE, so
+// the period is the same in seconds whatever rate the engine runs at.
+inline float clockLength(float knob_and_cv, bool multiplied) {
+  float length = knob_and_cv * 10.0f * (multiplied ? 100.0f : 1.0f);
+  return std::max(length, 1.0f);
+}
+
+// How far through a period of `length` (see clockLength()) one frame goes
+inline float clockDelta(float sample_time, float length) {
+  return sample_time / (length * (1.0f / PERIOD_REFERENCE_RATE));
+}
+
+// One stream of sample-and-hold noise. The noise is generated NOISE_BLOCK
+// samples at a time, coloured as needed, and handed out one held value at a
+// time. The Random is passed in, so that many sources can share one.
+struct NoiseSource {
+  // The value to hold next for TYPE noise at `volume`, after `last`. TYPE is
+  // a template parameter, so that the kernels calling this are compiled for
+  // each type with no switch in their loops.
+  template <NoiseType TYPE>
+  float next(Random &random, float last, float volume) {
+    if (TYPE == NoiseType::BROWNIAN) {
+      float step = 2 * (sample(random, NoiseType::WHITE_NOISE) - 0.5f);
+      last += step * volume / 10;
+      return std::min(std::max(0.0f, last), volume);
+    }
+    if (TYPE == NoiseType::TRIGGER) {
+      return sample(random, NoiseType::WHITE_NOISE) > volume / 10.0f ? 1.0f
+                                                                     : 0.0f;
+    }
+    return sample(random, TYPE) * volume;
+  }
+  // Drops the block and the filter state
+  void reset();
+
+private:
+  NoiseColourFilter colour;
+  float block[NOISE_BLOCK];
+  NoiseType block_type = NoiseType::WHITE_NOISE; // the colour of `block`
+  int pos = NOISE_BLOCK; // next unused sample in `block`
+
+  // The next sample of white, pink, blue or violet noise, in [0, 1]
+  float sample(Random &random, NoiseType type) {
+    if (pos == NOISE_BLOCK or type != block_type) {
+      fill(random, type);
+    }
+    return block[pos++];
+  }
+  void fill(Random &random, NoiseType type);
+};
+
+// The time to the next event of a Poisson process, in units of the mean time
+// between events: exponentially distributed with a mean of 1.
+inline float exponential(Random &random) {
+  return -logf(1.0f - random.uniform());
+}
+
+// Handles a Poisson event, when `phase` has counted up to `next`: draws the
+// time to the next event, and returns `pulse` (the frames left of the current
+// pulse) extended by one `width` frames long, timed from the event.
+float poissonEvent(Random &random, float &phase, float &next, float delta,
+                   float width, float pulse);
+
+// The DSP of the NoiseGenerator: a NoiseSource clocked by a phase
+// accumulator, with band limited steps between the held values. Given the
+// same Random state and inputs, the output is the same bit for bit.
+//
+// For POISSON_TRIGGER the phase counts up to an exponentially distributed
+// number of periods instead of to 1, which makes the events a Poisson process
+// with a rate of one per period (even while the period changes). Only the
+// events draw random numbers, and each starts a pulse of `volume`, `width`
+// frames long, timed from the exact moment of the event.
+struct NoiseVoice {
+  void reset();
+
+  // `n` frames of output into `out`, with the controls held over the block.
+  // `delta` is from clockDelta(). The type is dispatched once per block, to a
+  // kernel compiled for it.
+  void process(Random &random, NoiseType type, float delta, float volume,
+               float width, float *out, int n);
+
+private:
+  NoiseSource source;
+  MinBlep blep;
+  float phase = 0.0f; // through the current period
+  float held = 0.0f;
+  float next = -1.0f;  // periods to the next Poisson event, -1 until drawn
+  float pulse = 0.0f; // frames left of the current pulse
+
+  template <NoiseType TYPE>
+  void run(Random &random, float delta, float volume, float width, float *out,
+           int n);
+  template <NoiseType TYPE>
+  void step(Random &random, float delta, float volume);
+
+  float poisson(Random &random, float delta, float volume, float width) {
+    if (next < 0.0f) {
+      next = exponential(random);
+      phase = 0.0f;
+    }
+    phase += delta;
+    if (phase >= next) {
+      pulse = poissonEvent(random, phase, next, delta, width, pulse);
+      // The clocked modes count from here
+      held = 0.0f;
+    }
+    if (pulse > 0.0f) {
+      pulse -= 1.0f;
+      return volume;
+    }
+    return 0.0f;
+  }
+};
@@ -0,0 +1,98 @@
+#include "overview.hpp"
+
+#include <algorithm>
+
+Overview::Overview() {
+  for (Level &level : levels) {
+    level.entries.reset(new Entry[OVERVIEW_CAPACITY]);
+  }
+}
+
+void Overview::reset() {
+  for (Level &level : levels) {
+    level.count.store(0, std::memory_order_relaxed);
+    level.half = false;
+  }
+  bucket_frames = 0;
+}
+
+void Overview::push(const float *samples, int n, int channels) {
+  int i = 0;
+  while (i < n) {
+    // Up to the end of the frames, or of the bucket
+    int end = std::min(n, i + OVERVIEW_BUCKET - bucket_frames);
+    if (bucket_frames == 0) {
+      bucket.min = bucket.max = samples[i * channels];
+    }
+    for (int s = i * channels; s < end * channels; s++) {
+      bucket.min = std::min(bucket.min, samples[s]);
+      bucket.max = std::max(bucket.max, samples[s]);
+    }
+    bucket_frames += end - i;
+    i = end;
+    if (bucket_frames == OVERVIEW_BUCKET) {
+      bucket_frames = 0;
+      add(0, bucket);
+    }
+  }
+}
+
+// Appends `entry` to `level`, and every second one, merged with the one
+// before, to the level above
+void Overview::add(int level, const MinMax &entry) {
+  Level &l = levels[level];
+  uint64_t count = l.count.load(std::memory_order_relaxed);
+  Entry &slot = l.entries[count % OVERVIEW_CAPACITY];
+  slot.min.store(entry.min, std::memory_order_relaxed);
+  slot.max.store(entry.max, std::memory_order_relaxed);
+  l.count.store(count + 1, std::memory_order_release);
+  if (level + 1 == OVERVIEW_LEVELS) {
+    return;
+  }
+  if (not l.half) {
+    l.pending = entry;
+    l.half = true;
+  } else {
+    l.half = false;
+    MinMax merged;
+    merged.min = std::min(l.pending.min, entry.min);
+    merged.max = std::max(l.pending.max, entry.max);
+    add(level + 1, merged);
+  }
+}
+
+bool Overview::read(int width, std::vector<MinMax> &columns) const {
+  // The finest level with no more than two entries per column. Failing that
+  // the take is too long to keep, and the coarsest shows its latest part.
+  const uint64_t readable = OVERVIEW_CAPACITY / 2;
+  int chosen = OVERVIEW_LEVELS - 1;
+  uint64_t count = 0;
+  for (int level = 0; level < OVERVIEW_LEVELS; level++) {
+    count = levels[level].count.load(std::memory_order_acquire);
+    if (count <= std::min<uint64_t>(2 * width, readable)) {
+      chosen = level;
+      break;
+    }
+  }
+  if (count == 0 or width <= 0) {
+    return false;
+  }
+  const Level &l = levels[chosen];
+  uint64_t first = count > readable ? count - readable : 0;
+  uint64_t entries = count - first;
+  columns.resize(width);
+  for (int x = 0; x < width; x++) {
+    // Short takes stretch an entry over several columns
+    uint64_t begin = x * entries / width;
+    uint64_t end = std::max((x + 1) * entries / width, begin + 1);
+    MinMax &column = columns[x];
+    for (uint64_t i = begin; i < end; i++) {
+      const Entry &entry = l.entries[(first + i) % OVERVIEW_CAPACITY];
+      float min = entry.min.load(std::memory_order_relaxed);
+      float max = entry.max.load(std::memory_order_relaxed);
+      column.min = i == begin ? min : std::min(column.min, min);
+      column.max = i == begin ? max : std::max(column.max, max);
+    }
+  }
+  return true;
+}
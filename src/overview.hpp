@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Frames in each entry of the finest level
+#define OVERVIEW_BUCKET 256
+// Levels of the pyramid. Each level's entries span twice the frames of the
+// level below, up to 2^24 frames, so the half of the coarsest level that
+// gets read covers over 12 hours at 192kHz.
+#define OVERVIEW_LEVELS 17
+// Entries each level keeps, the newest ones
+#define OVERVIEW_CAPACITY 1024
+
+// The range of the samples in a stretch of a take
+struct MinMax {
+  float min = 0;
+  float max = 0;
+};
+
+// A min/max pyramid of a take, for drawing its waveform at any length.
+//
+// The audio thread pushes the recorded frames. Every OVERVIEW_BUCKET frames
+// it adds their min and max (over all channels) to the finest level, and
+// every other entry of a level is merged with the one before into the next
+// level up, so a frame costs O(1) amortized and nothing is ever rescanned.
+// Each level is a ring of the newest OVERVIEW_CAPACITY entries, allocated up
+// front.
+//
+// The UI thread reads the waveform from the finest level that holds the
+// whole take in about as many entries as it has columns to fill, so drawing
+// costs the same however long the take is. It only reads the newest half of
+// a ring, which the audio thread won't get around to overwriting while it
+// reads. The entries are still atomics, loaded and stored relaxed: `count`
+// publishes them, and a reader that is late anyway only draws a stale range.
+struct Overview {
+  Overview();
+
+  // Audio thread
+  void reset();
+  // `n` frames of `channels` interleaved samples
+  void push(const float *samples, int n, int channels);
+
+  // UI thread. Splits the take so far into `width` columns, oldest first,
+  // and returns their ranges. Returns false, with nothing in `columns`, if
+  // less than a bucket has been recorded.
+  bool read(int width, std::vector<MinMax> &columns) const;
+
+private:
+  struct Entry {
+    std::atomic<float> min{0};
+    std::atomic<float> max{0};
+  };
+  struct Level {
+    std::unique_ptr<Entry[]> entries; // ring of OVERVIEW_CAPACITY
+    std::atomic<uint64_t> count{0}; // entries ever added, published
+    MinMax pending;      // the first half of the next entry up
+    bool half = false;   // whether `pending` holds anything
+  };
+  Level levels[OVERVIEW_LEVELS];
+  // The bucket being filled
+  MinMax bucket;
+  int bucket_frames = 0;
+
+  void add(int level, const MinMax &entry);
+};
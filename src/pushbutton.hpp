@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PUSH_BUTTON_X86 1
+#include <xmmintrin.h>
+#endif
+
+// The DSP of the Push Buttons, without Rack. Before each block the module
+// reads its controls and set()s each channel's target; only the channels
+// that changed do any work after that, ramping to the new value. With no
+// ramp going, a block costs a test. CHANNELS is a multiple of 4, for the SIMD
+// pass.
+template <int CHANNELS> struct PushButtonCore {
+  static_assert(CHANNELS % 4 == 0, "channels go through SSE in fours");
+
+  alignas(16) float value[CHANNELS] = {}; // the outputs
+
+  // Ramps channel `i` to `t` over `frames` frames, or jumps there if that is
+  // less than one.
+  void set(int i, float t, float frames) {
+    if (t == target[i]) {
+      return;
+    }
+    target[i] = t;
+    if (frames < 1.0f) {
+      // A ramp with no increment ends on its first frame
+      value[i] = t;
+      increment[i] = 0.0f;
+    } else {
+      increment[i] = (t - value[i]) / frames;
+    }
+    ramping |= 1 << i;
+  }
+
+  // `n` frames of CHANNELS values into `out`, interleaved. Returns false,
+  // writing nothing, if no channel is ramping: the outputs hold their values.
+  bool process(float *out, int n) {
+    if (not ramping) {
+      return false;
+    }
+    for (int f = 0; f < n; f++) {
+      if (ramping) {
+        step();
+      }
+      std::copy(value, value + CHANNELS, &out[f * CHANNELS]);
+    }
+    return true;
+  }
+
+private:
+  int ramping = 0;   // mask of the channels on their way to `target`
+  alignas(16) float target[CHANNELS] = {};
+  alignas(16) float increment[CHANNELS] = {}; // per frame, while ramping
+
+  // Moves every ramping channel a frame closer to its target. A channel is
+  // done when the step takes it to or past the target. Done channels sit on
+  // the target with no increment, so all of them can go through the same
+  // pass. The loops have a constant trip count, which the compiler unrolls
+  // for each size.
+  void step() {
+    int done = 0;
+#ifdef PUSH_BUTTON_X86
+    const __m128 zero = _mm_setzero_ps();
+    for (int i = 0; i < CHANNELS; i += 4) {
+      __m128 t = _mm_load_ps(&target[i]);
+      __m128 inc = _mm_load_ps(&increment[i]);
+      __m128 v = _mm_add_ps(_mm_load_ps(&value[i]), inc);
+      __m128 end = _mm_cmple_ps(_mm_mul_ps(_mm_sub_ps(t, v), inc), zero);
+      v = _mm_or_ps(_mm_and_ps(end, t), _mm_andnot_ps(end, v));
+      _mm_store_ps(&value[i], v);
+      _mm_store_ps(&increment[i], _mm_andnot_ps(end, inc));
+      done |= _mm_movemask_ps(end) << i;
+    }
+#else
+    for (int i = 0; i < CHANNELS; i++) {
+      value[i] += increment[i];
+      if ((target[i] - value[i]) * increment[i] <= 0.0f) {
+        value[i] = target[i];
+        increment[i] = 0.0f;
+        done |= 1 << i;
+      }
+    }
+#endif
+    ramping &= ~done;
+  }
+};
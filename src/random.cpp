@@ -0,0 +1,66 @@
+#include "random.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RANDOM_X86 1
+#include <emmintrin.h>
+#endif
+
+// Spreads a 64 bit seed over the state, as recommended for the xoshiro family.
+static uint64_t splitmix64(uint64_t &x) {
+  uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+void Random::setSeed(uint64_t seed) {
+  for (int i = 0; i < 4; i++) {
+    uint64_t a = splitmix64(seed), b = splitmix64(seed);
+    s[0][i] = a;
+    s[1][i] = a >> 32;
+    s[2][i] = b;
+    s[3][i] = b >> 32;
+    // The all zero state never leaves zero
+    if ((s[0][i] | s[1][i] | s[2][i] | s[3][i]) == 0) {
+      s[0][i] = 1;
+    }
+  }
+  lane = 0;
+}
+
+void Random::fill(float *out, size_t n) {
+  size_t i = 0;
+  // Line up with lane 0, so that vectors come out in the same order
+  for (; i < n and lane != 0; i++) {
+    out[i] = uniform();
+  }
+#ifdef RANDOM_X86
+  if (n - i >= 4) {
+    __m128i s0 = _mm_load_si128(reinterpret_cast<__m128i *>(s[0]));
+    __m128i s1 = _mm_load_si128(reinterpret_cast<__m128i *>(s[1]));
+    __m128i s2 = _mm_load_si128(reinterpret_cast<__m128i *>(s[2]));
+    __m128i s3 = _mm_load_si128(reinterpret_cast<__m128i *>(s[3]));
+    const __m128i one = _mm_set1_epi32(0x3f800000);
+    for (; i + 4 <= n; i += 4) {
+      __m128i result = _mm_add_epi32(s0, s3);
+      __m128i t = _mm_slli_epi32(s1, 9);
+      s2 = _mm_xor_si128(s2, s0);
+      s3 = _mm_xor_si128(s3, s1);
+      s1 = _mm_xor_si128(s1, s2);
+      s0 = _mm_xor_si128(s0, s3);
+      s2 = _mm_xor_si128(s2, t);
+      s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+      __m128i bits = _mm_or_si128(_mm_srli_epi32(result, 9), one);
+      _mm_storeu_ps(out + i,
+                    _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.0f)));
+    }
+    _mm_store_si128(reinterpret_cast<__m128i *>(s[0]), s0);
+    _mm_store_si128(reinterpret_cast<__m128i *>(s[1]), s1);
+    _mm_store_si128(reinterpret_cast<__m128i *>(s[2]), s2);
+    _mm_store_si128(reinterpret_cast<__m128i *>(s[3]), s3);
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = uniform();
+  }
+}
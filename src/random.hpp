@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// A small, fast pseudo random number generator for audio rate noise, owned by
+// a single module instance (so there is no shared state or locking, unlike
+// rand()).
+//
+// This is xoshiro128+, run as four independent lanes that take turns, so that
+// fill() can step all four at once with SSE2. The scalar and vector paths
+// produce the same sequence for the same seed.
+struct Random {
+  explicit Random(uint64_t seed = 0) { setSeed(seed); }
+
+  // Restarts the sequence. Every seed, including 0, is fine.
+  void setSeed(uint64_t seed);
+
+  uint32_t next() {
+    int i = lane;
+    lane = (lane + 1) & 3;
+    uint32_t result = s[0][i] + s[3][i];
+    uint32_t t = s[1][i] << 9;
+    s[2][i] ^= s[0][i];
+    s[3][i] ^= s[1][i];
+    s[1][i] ^= s[2][i];
+    s[0][i] ^= s[3][i];
+    s[2][i] ^= t;
+    s[3][i] = (s[3][i] << 11) | (s[3][i] >> 21);
+    return result;
+  }
+
+  // Uniform in [0, 1). Only the top 23 bits are used, the low bits of
+  // xoshiro128+ being the weak ones.
+  float uniform() {
+    uint32_t bits = (next() >> 9) | 0x3f800000u;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f - 1.0f;
+  }
+
+  // Fills `out` with `n` uniform floats in [0, 1). This is the same as
+  // calling uniform() `n` times, but four at a time.
+  void fill(float *out, size_t n);
+
+private:
+  // s[k][i] is word k of lane i, so each word of all four lanes is one vector
+  alignas(16) uint32_t s[4][4];
+  int lane = 0; // the lane next() steps next
+};
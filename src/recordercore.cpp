@@ -0,0 +1,289 @@
+#include "recordercore.hpp"
+
+static RecordLink link_groups[NUM_LINK_GROUPS];
+
+RecorderCore::RecorderCore(int max_channels, float sample_rate)
+    : writer(RING_CAPACITY), meter(max_channels), max_channels(max_channels),
+      sample_rate(sample_rate) {
+  own_link.clock = this;
+  own_link.dirty = false;
+  meter.setSampleRate(sample_rate);
+  envelope_decay = expf(-STEP_BLOCK / (ENVELOPE_RELEASE * sample_rate));
+}
+
+RecorderCore::~RecorderCore() {
+  link().dirty = true;
+  // Make sure the writer is done with the pre-roll before freeing it.
+  writer.finish();
+  delete preroll;
+  delete next_preroll.load();
+  delete old_preroll.load();
+}
+
+RecordLink &RecorderCore::link() {
+  return settings.link_group < 0 ? own_link : link_groups[settings.link_group];
+}
+
+void RecorderCore::setSettings(const RecorderSettings &settings) {
+  requested = settings;
+  settings_pending = true;
+  sendPending();
+}
+
+void RecorderCore::sendPending() {
+  if (settings_pending) {
+    settings_pending = not commands.send(requested);
+  }
+}
+
+void RecorderCore::applySettings(const RecorderSettings &s) {
+  if (s.link_group != settings.link_group) {
+    setLinkGroup(s.link_group);
+  }
+  if (s.threshold_db != settings.threshold_db) {
+    // A take that is running carries on until the next silence
+    silent_frames = 0;
+    quiet = not recording;
+  }
+  settings = s;
+  threshold = s.threshold_db < 0
+                  ? METER_CLIP_VOLTAGE * powf(10.0f, s.threshold_db / 20.0f)
+                  : 0.0f;
+}
+
+void RecorderCore::setLinkGroup(int group) {
+  link().dirty = true;
+  settings.link_group = group;
+  link().dirty = true;
+}
+
+void RecorderCore::process(const float *frames, int n) {
+  commands.apply([this](const RecorderSettings &s) { applySettings(s); });
+  for (int i = 0; i < n; i++) {
+    meter.push(&frames[i * max_channels], num_channels);
+  }
+  if (threshold > 0) {
+    followLevel(frames, n);
+  }
+  // Also retries a start or stop that couldn't be done at the last block
+  setTaking(armed and not (threshold > 0 and quiet));
+  if (recording) {
+    // Note: The ring always has floats, the actual conversion is done by the
+    // writer thread. It only has the recorded channels.
+    const float *samples = frames;
+    if (num_channels < max_channels) {
+      for (int i = 0; i < n; i++) {
+        std::copy(&frames[i * max_channels],
+                  &frames[i * max_channels + num_channels],
+                  &packed[i * num_channels]);
+      }
+      samples = packed;
+    }
+    // A block the ring can't take is dropped whole, and left out of the
+    // length and the waveform too, so they match the file
+    if (writer.push(samples, n * num_channels)) {
+      overview.push(samples, n, num_channels);
+      num_samples += n;
+    } else {
+      TIMING_EVENT(timing, RING_FULL);
+      num_dropped += n;
+    }
+    take_frames += n;
+  } else {
+    for (int i = 0; i < n; i++) {
+      capture(&frames[i * max_channels]);
+    }
+  }
+  status_frames += n;
+  if (status_frames >= STATUS_INTERVAL) {
+    publishStatus();
+  }
+}
+
+// A peak envelope, updated once per block: the loudest sample of the block,
+// or the last envelope falling off over ENVELOPE_RELEASE. Going under the
+// threshold starts counting silence, and after `silence_seconds` of it the
+// input is `quiet`.
+void RecorderCore::followLevel(const float *frames, int n) {
+  float peak = 0.0f;
+  for (int i = 0; i < n; i++) {
+    for (int c = 0; c < num_channels; c++) {
+      peak = std::max(peak, std::fabs(frames[i * max_channels + c]));
+    }
+  }
+  envelope = std::max(peak, envelope * envelope_decay);
+  if (envelope > threshold) {
+    silent_frames = 0;
+    quiet = false;
+  } else {
+    silent_frames += n;
+    if (silent_frames >= settings.silence_seconds * sample_rate) {
+      quiet = true;
+    }
+  }
+}
+
+void RecorderCore::publishStatus() {
+  status_frames = 0;
+  RecorderStatus &status = statuses.write();
+  status.armed = armed;
+  status.recording = recording;
+  status.num_channels = num_channels;
+  status.num_samples = num_samples;
+  status.num_dropped = num_dropped;
+  statuses.publish();
+}
+
+void RecorderCore::setPreroll(float seconds) {
+  preroll_seconds = seconds;
+  PrerollBuffer *buffer = new PrerollBuffer();
+  buffer->frames = seconds * sample_rate;
+  buffer->channels = preroll_channels;
+  buffer->data.resize(buffer->frames * buffer->channels);
+  delete next_preroll.exchange(buffer);
+  delete old_preroll.exchange(nullptr);
+}
+
+// Adopts the buffer from setPreroll(). Waits until the writer is done with the
+// current one, and until the UI thread has collected the last one replaced.
+void RecorderCore::swapPreroll() {
+  if (preroll_busy.load(std::memory_order_acquire) or
+      old_preroll.load(std::memory_order_relaxed)) {
+    return;
+  }
+  TIMING_EVENT(timing, PREROLL_SWAP);
+  old_preroll.store(preroll, std::memory_order_release);
+  preroll = next_preroll.exchange(nullptr, std::memory_order_acquire);
+  preroll_pos = 0;
+  preroll_count = 0;
+}
+
+void RecorderCore::maintainPreroll(int channels) {
+  if (old_preroll.load(std::memory_order_acquire)) {
+    delete old_preroll.exchange(nullptr, std::memory_order_acquire);
+  }
+  channels = std::max(1, std::min(channels, max_channels));
+  if (channels != preroll_channels) {
+    preroll_channels = channels;
+    if (preroll_seconds > 0) {
+      setPreroll(preroll_seconds);
+    }
+  }
+}
+
+// Lends the pre-roll collected so far to the writer; once the writer has
+// taken it, startTake() starts collecting over. A
+// pre-roll with fewer channels than the take, from before the channels were
+// patched, is left out.
+Preroll RecorderCore::takePreroll() {
+  Preroll taken;
+  if (preroll_count == 0 or preroll_busy.load(std::memory_order_acquire) or
+      preroll->channels < num_channels) {
+    return taken;
+  }
+  taken.frames = preroll->data.data();
+  taken.capacity = preroll->frames;
+  taken.stride = preroll->channels;
+  taken.first = (preroll_pos + preroll->frames - preroll_count) % preroll->frames;
+  taken.count = preroll_count;
+  taken.busy = &preroll_busy;
+  preroll_busy.store(true, std::memory_order_relaxed);
+  return taken;
+}
+
+void RecorderCore::updateRecording(bool button_on) {
+  RecordLink &link = this->link();
+  if (link.dirty) {
+    findClock(link);
+  }
+
+  // Only a change of the button is a request, so that linked Recorders whose
+  // buttons weren't touched don't fight over the state.
+  if (button_on != last_button) {
+    link.request = button_on;
+    link.has_request = true;
+    last_button = button_on;
+  }
+  if (link.clock == this and link.has_request) {
+    link.recording = link.request;
+    link.has_request = false;
+  }
+
+  if (armed != link.recording) {
+    armed = link.recording;
+    // Let the panel know straight away
+    publishStatus();
+  }
+  // Auto-split only starts the take once there is something to record
+  setTaking(armed and not (threshold > 0 and quiet));
+}
+
+// Starts or stops a take. The writer thread takes care of naming, finishing
+// and closing the files, so auto-split can do this at any block. A take isn't
+// stopped before MIN_TAKE_SECONDS, and if the writer's command queue is full
+// nothing changes; either way process() tries again at the next block.
+void RecorderCore::setTaking(bool take) {
+  if (take == recording) {
+    return;
+  }
+  if (take) {
+    if (not startTake()) {
+      return;
+    }
+  } else {
+    if (take_frames < MIN_TAKE_SECONDS * sample_rate) {
+      return;
+    }
+    if (not writer.stop()) {
+      TIMING_EVENT(timing, COMMAND_FULL);
+      return;
+    }
+    TIMING_EVENT(timing, TAKE_STOP);
+  }
+  recording = take;
+  // Let the panel know straight away
+  publishStatus();
+}
+
+bool RecorderCore::startTake() {
+  TakeSettings take;
+  take.format = settings.format;
+  take.num_channels = num_channels;
+  take.sample_rate = sample_rate;
+  take.output_rate =
+      settings.output_rate ? settings.output_rate : take.sample_rate;
+  take.quality = settings.resample_quality;
+  take.dither = settings.dither;
+  take.split = settings.split;
+  take.sink = settings.sink;
+  Preroll taken = takePreroll();
+  if (not writer.start(take, taken)) {
+    // The writer never saw the pre-roll, so keep collecting it
+    if (taken.busy) {
+      preroll_busy.store(false, std::memory_order_relaxed);
+    }
+    TIMING_EVENT(timing, COMMAND_FULL);
+    return false;
+  }
+  preroll_pos = 0;
+  preroll_count = 0;
+  TIMING_EVENT(timing, TAKE_START);
+  meter.resetClips();
+  overview.reset();
+  num_samples = taken.count;
+  num_dropped = 0;
+  take_frames = 0;
+  if (taken.count == 0) {
+    // Push an initial empty sample to make sure the file doesn't start
+    // silent (otherwise, some programs interpret the WAV as corrupt or
+    // completly empty).
+    static const float lead_in[MAX_CHANNELS] = {
+        0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1,
+        0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1,
+    };
+    int n = std::max(num_channels, 2);
+    writer.push(lead_in, n);
+    num_samples = n / num_channels;
+  }
+  return true;
+}
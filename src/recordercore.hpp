@@ -0,0 +1,239 @@
+#pragma once
+
+#include "block.hpp"
+#include "commands.hpp"
+#include "diskwriter.hpp"
+#include "meter.hpp"
+#include "overview.hpp"
+#include "snapshot.hpp"
+#include "timing.hpp"
+#include "wavwriter.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+// Size of the ring between the audio thread and the disk writer, in samples.
+// This is about 5 seconds of stereo audio at 192kHz.
+#define RING_CAPACITY (1 << 21)
+// Most channels any Recorder records at once
+#define MAX_CHANNELS 16
+// Recorders in the same link group start and stop on the same engine frame
+#define NUM_LINK_GROUPS 4
+// How fast the level that auto-split follows falls after a peak, in seconds
+#define ENVELOPE_RELEASE 0.05f
+// Shortest take, in seconds. A gate that goes low sooner stops the take only
+// then, so a chattering gate can't open files faster than they are written.
+#define MIN_TAKE_SECONDS 0.1f
+
+struct RecorderCore;
+
+// The shared start/stop state of a group of linked Recorders. Apart from
+// `dirty`, this is only touched from step(), which all runs on the engine
+// thread.
+struct RecordLink {
+  // The member that comes first in engine order. Its step() runs before any
+  // other member's in every frame, so it is the one that applies requests:
+  // every member then sees the new state in the same frame.
+  RecorderCore *clock = nullptr;
+  // Set when membership may have changed, so the clock has to be found again
+  std::atomic<bool> dirty{true};
+  bool has_request = false;
+  bool request = false;
+  bool recording = false;
+};
+
+// Circular buffer of the audio before a take, see RecorderCore::setPreroll()
+struct PrerollBuffer {
+  std::vector<float> data;
+  size_t frames = 0;
+  int channels = 0; // samples kept per frame
+};
+
+// The settings in the Recorder's menu. The UI thread keeps its own copy and
+// sends a new one for every change; the audio thread picks it up at the start
+// of its next block, and apart from auto-split only looks at it when a take
+// starts.
+struct RecorderSettings {
+  SampleFmt format = SampleFmt::FLOAT_32;
+  bool dither = false; // TPDF dither for the integer formats
+  bool split = false;  // one mono file per channel
+  int output_rate = 0; // sample rate of the file, 0 for the engine's
+  int resample_quality = SRC_SINC_MEDIUM_QUALITY;
+  SinkType sink = SinkType::STDIO_SINK; // how the files are written
+  int link_group = -1; // -1 when not linked
+  // Auto-split: while armed, a take only runs while the input is louder than
+  // `threshold_db` (dB below full scale, 0 when off). After `silence_seconds`
+  // below it the take stops, and the next sound starts a new file.
+  int threshold_db = 0;
+  float silence_seconds = 2;
+};
+
+// What the panel shows, published by the audio thread
+struct RecorderStatus {
+  bool armed = false;     // the button or gate, or a linked Recorder's
+  bool recording = false; // a take is running, unless auto-split paused it
+  int num_channels = 0;   // to record, set by the patched inputs
+  size_t num_samples = 0; // frames in the current take's files
+  size_t num_dropped = 0; // frames of it lost because the writer fell behind
+};
+
+// The DSP of the Recorder modules, without Rack: the record button, linking,
+// pre-roll, metering, the waveform and the disk writer. The modules pick the
+// channels and pass in frames; bench/modules drives it offline.
+struct RecorderCore {
+  DiskWriter writer; // streams the samples to disk on its own thread
+  Meter meter;
+  Overview overview; // of the current take, without its pre-roll
+  int num_channels = 1;
+  float preroll_seconds = 0; // UI thread
+  const int max_channels; // size of the frames passed to stepRecorder()
+#ifdef MICROTOOLS_PROFILE
+  StepTiming timing; // timed by the modules' step()
+#endif
+
+  RecorderCore(int max_channels, float sample_rate);
+  virtual ~RecorderCore();
+
+  // UI thread
+  const RecorderSettings &getSettings() const { return requested; }
+  void setSettings(const RecorderSettings &settings);
+  // Call regularly: sends the settings again if they didn't fit in the queue,
+  // so the audio thread catches up with the menu
+  void sendPending();
+  // The reference stays valid until the next call
+  const RecorderStatus &getStatus() { return statuses.read(); }
+  // Keeps the last `seconds` of audio while not recording, and starts each
+  // take with it. The buffer is allocated here, on the calling (UI) thread,
+  // and handed over to the audio thread. It holds as many channels as were
+  // last passed to maintainPreroll().
+  void setPreroll(float seconds);
+  // Call regularly with the channel count from getStatus(). Frees the buffer
+  // the audio thread has replaced, and resizes the pre-roll when the number
+  // of channels to record changes.
+  void maintainPreroll(int channels);
+  // UI thread, while the audio thread is stopped
+  void setSampleRate(float rate) {
+    sample_rate = rate;
+    setPreroll(preroll_seconds);
+    meter.setSampleRate(rate);
+    envelope_decay = expf(-STEP_BLOCK / (ENVELOPE_RELEASE * rate));
+  }
+
+  // Audio thread. The block API: before processing the next frame, call
+  // update() if changed() says the take may start or stop there. Frames have
+  // `max_channels` samples, of which the first `num_channels` get recorded.
+  bool changed(bool button_on) {
+    RecordLink &link = this->link();
+    return button_on != last_button or link.dirty or link.has_request or
+           link.recording != armed;
+  }
+  void update(bool button_on) {
+    commands.apply([this](const RecorderSettings &s) { applySettings(s); });
+    updateRecording(button_on);
+  }
+  // Records (or pre-rolls) and meters `n` frames, at most STEP_BLOCK
+  void process(const float *frames, int n);
+
+  // Audio thread. The adapter for step(): call once per frame with the state
+  // of the record button (or gate) and a frame. Frames are collected into blocks of
+  // STEP_BLOCK for process(), and a block ends early where the take starts
+  // or stops, so that happens on the exact frame.
+  void stepRecorder(bool button_on, const float *frame) {
+    if (changed(button_on)) {
+      flush();
+      update(button_on);
+    }
+    std::copy(frame, frame + max_channels, &input[fill * max_channels]);
+    if (++fill == STEP_BLOCK) {
+      flush();
+    }
+  }
+
+  bool isRecording() const { return recording; } // audio thread
+
+protected:
+  RecordLink &link();
+  // Makes the first member of `link` in processing order its clock. Only
+  // called when membership changes. Offline there is no engine order, so by
+  // default the first core to look is the clock.
+  virtual void findClock(RecordLink &link) {
+    link.dirty = false;
+    link.clock = this;
+  }
+
+private:
+  float sample_rate;
+
+  // Audio thread
+  RecorderSettings settings;
+  bool armed = false; // the link is recording
+  bool recording = false;
+  // Auto-split, see followLevel()
+  float threshold = 0; // in volts, 0 when off
+  float envelope = 0;
+  float envelope_decay; // per block
+  size_t silent_frames = 0;
+  bool quiet = true; // silent for long enough to stop a take
+  size_t num_samples = 0;
+  size_t num_dropped = 0;
+  size_t take_frames = 0; // since the take started, without pre-roll
+  int status_frames = 0;
+  bool last_button = false;
+  RecordLink own_link; // used when not linked
+  float input[STEP_BLOCK * MAX_CHANNELS]; // frames for the next process()
+  int fill = 0;
+  float packed[STEP_BLOCK * MAX_CHANNELS]; // `num_channels` per frame
+
+  // Pre-roll. `preroll` belongs to the audio thread; new buffers come in
+  // through `next_preroll` and replaced ones go back through `old_preroll` to
+  // be freed by the UI thread.
+  PrerollBuffer *preroll = nullptr;
+  size_t preroll_pos = 0;   // where the next frame goes
+  size_t preroll_count = 0; // how many frames are valid
+  std::atomic<bool> preroll_busy{false}; // set while the writer copies it
+  std::atomic<PrerollBuffer *> next_preroll{nullptr};
+  std::atomic<PrerollBuffer *> old_preroll{nullptr};
+  int preroll_channels = 1; // UI thread
+
+  RecorderSettings requested; // UI thread's copy of `settings`
+  bool settings_pending = false; // `requested` hasn't made it into the queue
+  CommandQueue<RecorderSettings> commands;
+  TripleBuffer<RecorderStatus> statuses;
+
+  void applySettings(const RecorderSettings &s);
+  void setLinkGroup(int group);
+  void publishStatus();
+  void updateRecording(bool button_on);
+  void followLevel(const float *frames, int n);
+  void setTaking(bool take);
+  bool startTake();
+  Preroll takePreroll();
+
+  void flush() {
+    if (fill > 0) {
+      process(input, fill);
+      fill = 0;
+    }
+  }
+
+  void capture(const float *frame) {
+    if (next_preroll.load(std::memory_order_relaxed)) {
+      swapPreroll();
+    }
+    if (not preroll or preroll->frames == 0 or
+        preroll_busy.load(std::memory_order_acquire)) {
+      return;
+    }
+    std::copy(frame, frame + preroll->channels,
+              &preroll->data[preroll_pos * preroll->channels]);
+    if (++preroll_pos == preroll->frames) {
+      preroll_pos = 0;
+    }
+    if (preroll_count < preroll->frames) {
+      preroll_count++;
+    }
+  }
+  void swapPreroll();
+};
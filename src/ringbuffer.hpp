@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A lock-free single-producer/single-consumer ring buffer. All of the memory
+// is allocated up front, so neither side ever allocates. One thread may call
+// push(), and one (other) thread may call pop()/peek().
+//
+// The read and write positions are free running counters; the index into the
+// storage is just the position masked by the (power of two) capacity.
+template <typename T> struct SPSCRing {
+  explicit SPSCRing(size_t min_capacity) {
+    size_t capacity = 1;
+    while (capacity < min_capacity) {
+      capacity <<= 1;
+    }
+    storage.resize(capacity);
+    mask = capacity - 1;
+  }
+
+  size_t capacity() const { return storage.size(); }
+
+  // Number of items that can currently be read (consumer side)
+  size_t readAvailable() const {
+    return write_pos.load(std::memory_order_acquire) -
+           read_pos.load(std::memory_order_relaxed);
+  }
+
+  // Number of items that can currently be written (producer side)
+  size_t writeAvailable() const {
+    return capacity() - (write_pos.load(std::memory_order_relaxed) -
+                         read_pos.load(std::memory_order_acquire));
+  }
+
+  // Total number of items ever pushed. Safe to call from the producer, and
+  // from the consumer as an upper bound on what it can read.
+  uint64_t written() const { return write_pos.load(std::memory_order_acquire); }
+
+  // Total number of items ever popped.
+  uint64_t read() const { return read_pos.load(std::memory_order_acquire); }
+
+  // Pushes all `n` items, or none of them if there isn't room. Returns true if
+  // the items were pushed.
+  bool push(const T *data, size_t n) {
+    uint64_t w = write_pos.load(std::memory_order_relaxed);
+    uint64_t r = read_pos.load(std::memory_order_acquire);
+    if (capacity() - (w - r) < n) {
+      return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+      storage[(w + i) & mask] = data[i];
+    }
+    write_pos.store(w + n, std::memory_order_release);
+    return true;
+  }
+
+  bool push(const T &item) { return push(&item, 1); }
+
+  // Copies up to `n` items into `data` without consuming them. Returns the
+  // number of items copied.
+  size_t peek(T *data, size_t n) const {
+    uint64_t r = read_pos.load(std::memory_order_relaxed);
+    uint64_t w = write_pos.load(std::memory_order_acquire);
+    if (n > w - r) {
+      n = w - r;
+    }
+    for (size_t i = 0; i < n; i++) {
+      data[i] = storage[(r + i) & mask];
+    }
+    return n;
+  }
+
+  // Marks `n` items as consumed. `n` must not exceed readAvailable().
+  void skip(size_t n) {
+    read_pos.store(read_pos.load(std::memory_order_relaxed) + n,
+                   std::memory_order_release);
+  }
+
+  // Copies and consumes up to `n` items. Returns the number of items popped.
+  size_t pop(T *data, size_t n) {
+    n = peek(data, n);
+    skip(n);
+    return n;
+  }
+
+  bool pop(T &item) { return pop(&item, 1) == 1; }
+
+private:
+  std::vector<T> storage;
+  size_t mask;
+  // Each counter is only ever written by one side. Keep them on separate cache
+  // lines so the producer and consumer don't fight over them.
+  alignas(64) std::atomic<uint64_t> write_pos{0};
+  alignas(64) std::atomic<uint64_t> read_pos{0};
+};
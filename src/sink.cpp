@@ -0,0 +1,319 @@
+#include "sink.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#define SINK_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Size of StdioSink's buffer, so that small writes reach the OS as a few
+// large ones
+#define FILE_BUFFER_SIZE (1 << 20)
+// How much of the file MmapSink preallocates and maps at a time
+#define MMAP_WINDOW (64 << 20)
+// Direct I/O needs buffers, offsets and lengths aligned to the device's
+// logical block size. 4096 covers every common device.
+#define DIRECT_ALIGN 4096
+// How much DirectSink collects before writing it out
+#define DIRECT_BUFFER_SIZE (1 << 20)
+
+const char *toString(SinkType type) {
+  switch (type) {
+  case SinkType::STDIO_SINK:
+    return "Buffered";
+  case SinkType::MMAP_SINK:
+    return "Memory mapped";
+  case SinkType::DIRECT_SINK:
+    return "Direct";
+  default:
+    return "Unknown";
+  }
+}
+
+namespace {
+
+struct StdioSink : Sink {
+  FILE *file = nullptr;
+
+  ~StdioSink() { close(); }
+
+  bool open(const char *filename) override {
+    // Note: This is "write bytes" as to avoid Windows from sticking
+    // `0d = \r` before every `0a = \n`.
+    file = fopen(filename, "wb");
+    if (not file) {
+      return false;
+    }
+    setvbuf(file, nullptr, _IOFBF, FILE_BUFFER_SIZE);
+    length = 0;
+    return true;
+  }
+
+  void write(const void *data, size_t n) override {
+    fwrite(data, 1, n, file);
+    length += n;
+  }
+
+  void rewrite(uint64_t offset, const void *data, size_t n) override {
+    fseek(file, offset, SEEK_SET);
+    fwrite(data, 1, n, file);
+    fseek(file, 0, SEEK_END);
+  }
+
+  void flush() override { fflush(file); }
+
+  void close() override {
+    if (file) {
+      fclose(file);
+      file = nullptr;
+    }
+  }
+};
+
+#ifdef SINK_POSIX
+
+void report(const char *what) {
+  printf("%s failed: %s\n", what, strerror(errno));
+}
+
+// Writes into a shared mapping of the file, so the data goes straight into
+// the page cache without a copy through stdio or a system call per write.
+// The file is grown with fallocate (where there is one) a window ahead of
+// the data, so the filesystem can lay it out contiguously and running out of
+// space shows up there instead of as a SIGBUS on the mapping.
+struct MmapSink : Sink {
+  int fd = -1;
+  uint8_t *window = nullptr;
+  uint64_t window_start = 0;
+
+  ~MmapSink() { close(); }
+
+  bool open(const char *filename) override {
+    fd = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      return false;
+    }
+    length = 0;
+    map(0);
+    return true;
+  }
+
+  // Maps the window starting at `start`, which must be a multiple of
+  // MMAP_WINDOW. On failure `window` stays null and writes fall back to
+  // pwrite().
+  void map(uint64_t start) {
+    unmap();
+    window_start = start;
+#ifdef __linux__
+    int error = posix_fallocate(fd, start, MMAP_WINDOW);
+#else
+    int error = ftruncate(fd, start + MMAP_WINDOW) ? errno : 0;
+#endif
+    if (error) {
+      errno = error;
+      report("Preallocating");
+      return;
+    }
+    void *address = mmap(nullptr, MMAP_WINDOW, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, start);
+    if (address == MAP_FAILED) {
+      report("Mapping");
+      return;
+    }
+    window = static_cast<uint8_t *>(address);
+  }
+
+  void unmap() {
+    if (window) {
+      munmap(window, MMAP_WINDOW);
+      window = nullptr;
+    }
+  }
+
+  void write(const void *data, size_t n) override {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    while (n > 0) {
+      if (length >= window_start + MMAP_WINDOW) {
+        map(window_start + MMAP_WINDOW);
+      }
+      size_t take = std::min<uint64_t>(n, window_start + MMAP_WINDOW - length);
+      if (window) {
+        memcpy(window + (length - window_start), bytes, take);
+      } else if (pwrite(fd, bytes, take, length) < 0) {
+        report("Writing");
+      }
+      length += take;
+      bytes += take;
+      n -= take;
+    }
+  }
+
+  void rewrite(uint64_t offset, const void *data, size_t n) override {
+    // The page cache is shared with the mapping, so this is coherent with it
+    if (pwrite(fd, data, n, offset) < 0) {
+      report("Writing");
+    }
+  }
+
+  // The mapped pages already belong to the OS, which writes them back even
+  // if the process dies.
+  void flush() override {}
+
+  void close() override {
+    if (fd < 0) {
+      return;
+    }
+    unmap();
+    // Give back what was preallocated past the end
+    if (ftruncate(fd, length)) {
+      report("Truncating");
+    }
+    ::close(fd);
+    fd = -1;
+  }
+};
+
+// Writes aligned blocks straight from its own buffer to the device, bypassing
+// the page cache (O_DIRECT, or F_NOCACHE on macOS). Long takes then don't
+// evict everything else from memory, and the write latency is the device's
+// own rather than that of a burst of writeback.
+struct DirectSink : Sink {
+  int fd = -1;
+  uint8_t *buffer = nullptr; // DIRECT_BUFFER_SIZE, aligned
+  uint8_t *block = nullptr;  // DIRECT_ALIGN, aligned, for rewrites
+  size_t fill = 0;
+  uint64_t written = 0; // bytes before `buffer`, always aligned
+
+  ~DirectSink() {
+    close();
+    free(buffer);
+    free(block);
+  }
+
+  bool open(const char *filename) override {
+    if (not buffer and
+        (posix_memalign(reinterpret_cast<void **>(&buffer), DIRECT_ALIGN,
+                        DIRECT_BUFFER_SIZE) or
+         posix_memalign(reinterpret_cast<void **>(&block), DIRECT_ALIGN,
+                        DIRECT_ALIGN))) {
+      return false;
+    }
+    int flags = O_RDWR | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    fd = ::open(filename, flags | O_DIRECT, 0644);
+    if (fd < 0 and errno == EINVAL) {
+      // Some filesystems (tmpfs for one) refuse it. The writes stay aligned
+      // and simply go through the page cache.
+      fd = ::open(filename, flags, 0644);
+    }
+#else
+    fd = ::open(filename, flags, 0644);
+#ifdef F_NOCACHE
+    if (fd >= 0) {
+      fcntl(fd, F_NOCACHE, 1);
+    }
+#endif
+#endif
+    if (fd < 0) {
+      return false;
+    }
+    length = 0;
+    fill = 0;
+    written = 0;
+    return true;
+  }
+
+  void write(const void *data, size_t n) override {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    while (n > 0) {
+      size_t take = std::min(n, DIRECT_BUFFER_SIZE - fill);
+      memcpy(buffer + fill, bytes, take);
+      fill += take;
+      length += take;
+      bytes += take;
+      n -= take;
+      if (fill == DIRECT_BUFFER_SIZE) {
+        if (pwrite(fd, buffer, fill, written) < 0) {
+          report("Writing");
+        }
+        written += fill;
+        fill = 0;
+      }
+    }
+  }
+
+  void rewrite(uint64_t offset, const void *data, size_t n) override {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    while (n > 0) {
+      if (offset >= written) {
+        // Still in the buffer
+        memcpy(buffer + (offset - written), bytes, n);
+        return;
+      }
+      // Already on disk, so read, modify and write back the whole block
+      uint64_t block_start = offset - offset % DIRECT_ALIGN;
+      size_t within = offset - block_start;
+      size_t take = std::min<size_t>(n, DIRECT_ALIGN - within);
+      if (pread(fd, block, DIRECT_ALIGN, block_start) < 0) {
+        report("Reading");
+      }
+      memcpy(block + within, bytes, take);
+      if (pwrite(fd, block, DIRECT_ALIGN, block_start) < 0) {
+        report("Writing");
+      }
+      offset += take;
+      bytes += take;
+      n -= take;
+    }
+  }
+
+  // Writes out the partial block at the end, padded to the alignment. It
+  // stays in the buffer, and is written again once it fills up.
+  void flush() override {
+    if (fill == 0) {
+      return;
+    }
+    size_t padded = (fill + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    memset(buffer + fill, 0, padded - fill);
+    if (pwrite(fd, buffer, padded, written) < 0) {
+      report("Writing");
+    }
+  }
+
+  void close() override {
+    if (fd < 0) {
+      return;
+    }
+    flush();
+    // Cut off the padding
+    if (ftruncate(fd, length)) {
+      report("Truncating");
+    }
+    ::close(fd);
+    fd = -1;
+  }
+};
+
+#endif
+
+} // namespace
+
+std::unique_ptr<Sink> createSink(SinkType type) {
+  switch (type) {
+#ifdef SINK_POSIX
+  case SinkType::MMAP_SINK:
+    return std::unique_ptr<Sink>(new MmapSink());
+  case SinkType::DIRECT_SINK:
+    return std::unique_ptr<Sink>(new DirectSink());
+#endif
+  default:
+    return std::unique_ptr<Sink>(new StdioSink());
+  }
+}
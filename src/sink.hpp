@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+// Ways of getting a file's bytes to disk
+enum SinkType {
+  // Buffered stdio, the portable default
+  STDIO_SINK,
+  // A memory mapped file, preallocated and mapped in large windows
+  MMAP_SINK,
+  // Unbuffered, page-aligned writes that bypass the OS page cache
+  DIRECT_SINK,
+};
+
+const char *toString(SinkType type);
+
+// Where a recording's bytes go. Files are written front to back, apart from
+// headers rewritten in place once the length is known.
+//
+// Sinks are only used from the disk writer thread, so they may block.
+struct Sink {
+  virtual ~Sink() {}
+
+  // Creates (or truncates) `filename`. Returns false on failure.
+  virtual bool open(const char *filename) = 0;
+  // Appends `n` bytes to the end of the file.
+  virtual void write(const void *data, size_t n) = 0;
+  // Overwrites `n` bytes that were already written, at `offset`.
+  virtual void rewrite(uint64_t offset, const void *data, size_t n) = 0;
+  // Hands everything written so far over to the OS, so it is on disk even if
+  // the process dies.
+  virtual void flush() = 0;
+  // Flushes and closes the file. Nothing should be written afterwards.
+  virtual void close() = 0;
+
+  // Bytes written so far
+  uint64_t size() const { return length; }
+
+protected:
+  uint64_t length = 0;
+};
+
+// Returns a sink of the given type. Types the platform can't do fall back to
+// STDIO_SINK.
+std::unique_ptr<Sink> createSink(SinkType type);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+
+// Frames between the status snapshots a module publishes for its panel. At
+// 48kHz this is about 200 per second, more than the UI ever draws.
+#define STATUS_INTERVAL 256
+
+// Hands the latest version of a value from one thread to another without
+// locks or waiting (a triple buffer). The writer fills in write() and then
+// publish()es it; the reader always gets the most recently published version
+// from read(). Versions in between may be skipped, and neither side ever
+// sees the other halfway through.
+//
+// Exactly one thread may write, and one (other) thread may read.
+template <typename T> struct TripleBuffer {
+  // Writer side
+  T &write() { return buffers[back]; }
+  void publish() {
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // Reader side. The reference stays valid until the next read().
+  const T &read() {
+    if (middle.load(std::memory_order_relaxed) & FRESH) {
+      front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+    }
+    return buffers[front];
+  }
+
+private:
+  static const int INDEX = 3;
+  static const int FRESH = 4; // set when `middle` holds an unread version
+
+  T buffers[3] = {};
+  int back = 0; // writer's
+  std::atomic<int> middle{1};
+  int front = 2; // reader's
+};
@@ -0,0 +1,108 @@
+#include "timing.hpp"
+
+#ifdef MICROTOOLS_PROFILE
+
+const char *toString(TimingEvent event) {
+  switch (event) {
+  case TAKE_START:
+    return "Take start";
+  case TAKE_STOP:
+    return "Take stop";
+  case PREROLL_SWAP:
+    return "Pre-roll swap";
+  case RING_FULL:
+    return "Ring full";
+  case COMMAND_FULL:
+    return "Command full";
+  case PLAY_START:
+    return "Play start";
+  default:
+    return "";
+  }
+}
+
+StepTiming::StepTiming()
+    : start_ticks(timingTicks()), start_time(std::chrono::steady_clock::now()) {}
+
+void StepTiming::clear() {
+  reset_request.store(false, std::memory_order_relaxed);
+  steps.store(0, std::memory_order_relaxed);
+  total.store(0, std::memory_order_relaxed);
+  worst.store(0, std::memory_order_relaxed);
+  for (Counter &c : buckets) {
+    c.store(0, std::memory_order_relaxed);
+  }
+  for (int e = 0; e < NUM_TIMING_EVENTS; e++) {
+    events[e].store(0, std::memory_order_relaxed);
+    event_worst[e].store(0, std::memory_order_relaxed);
+  }
+}
+
+// The counters are read one at a time while the audio thread carries on, so
+// they can be a step apart, which doesn't matter at these counts.
+TimingReport StepTiming::report() const {
+  TimingReport r;
+  double ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - start_time)
+                  .count();
+  uint64_t ticks = timingTicks() - start_ticks;
+  r.ns_per_tick = ticks ? ns / ticks : 1;
+  r.steps = steps.load(std::memory_order_relaxed);
+  r.total_ns = total.load(std::memory_order_relaxed) * r.ns_per_tick;
+  r.worst_ns = worst.load(std::memory_order_relaxed) * r.ns_per_tick;
+  for (int i = 0; i < TIMING_BUCKETS; i++) {
+    r.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+  }
+  for (int e = 0; e < NUM_TIMING_EVENTS; e++) {
+    r.events[e] = events[e].load(std::memory_order_relaxed);
+    r.event_worst_ns[e] =
+        event_worst[e].load(std::memory_order_relaxed) * r.ns_per_tick;
+  }
+  return r;
+}
+
+void TimingReport::writeJson(FILE *f, const char *module) const {
+  fprintf(f, "{\n  \"module\": \"%s\",\n", module);
+  fprintf(f, "  \"steps\": %llu,\n", (unsigned long long)steps);
+  fprintf(f, "  \"mean_ns\": %.1f,\n", steps ? total_ns / steps : 0.0);
+  fprintf(f, "  \"worst_ns\": %.1f,\n", worst_ns);
+  fprintf(f, "  \"histogram\": [");
+  const char *separator = "\n";
+  for (int i = 0; i < TIMING_BUCKETS; i++) {
+    if (buckets[i]) {
+      fprintf(f, "%s    {\"from_ns\": %.1f, \"to_ns\": %.1f, \"steps\": %llu}",
+              separator, bucketNs(i), bucketNs(i + 1),
+              (unsigned long long)buckets[i]);
+      separator = ",\n";
+    }
+  }
+  fprintf(f, "\n  ],\n  \"events\": [");
+  separator = "\n";
+  for (int e = 0; e < NUM_TIMING_EVENTS; e++) {
+    fprintf(f, "%s    {\"event\": \"%s\", \"count\": %llu, \"worst_ns\": %.1f}",
+            separator, toString(TimingEvent(e)),
+            (unsigned long long)events[e], event_worst_ns[e]);
+    separator = ",\n";
+  }
+  fprintf(f, "\n  ]\n}\n");
+}
+
+// One row per bucket and per event, so several modules' files can be
+// concatenated (after the header) and sorted in a spreadsheet
+void TimingReport::writeCsv(FILE *f, const char *module) const {
+  fprintf(f, "module,kind,name,from_ns,to_ns,count,worst_ns\n");
+  fprintf(f, "%s,steps,all,,,%llu,%.1f\n", module, (unsigned long long)steps,
+          worst_ns);
+  for (int i = 0; i < TIMING_BUCKETS; i++) {
+    if (buckets[i]) {
+      fprintf(f, "%s,bucket,,%.1f,%.1f,%llu,\n", module, bucketNs(i),
+              bucketNs(i + 1), (unsigned long long)buckets[i]);
+    }
+  }
+  for (int e = 0; e < NUM_TIMING_EVENTS; e++) {
+    fprintf(f, "%s,event,%s,,,%llu,%.1f\n", module, toString(TimingEvent(e)),
+            (unsigned long long)events[e], event_worst_ns[e]);
+  }
+}
+
+#endif
@@ -0,0 +1,143 @@
+#pragma once
+
+// Timing of the modules' step(), for finding out which module makes the
+// engine drop out. It is only built in with `make PROFILE=1`, which defines
+// MICROTOOLS_PROFILE; otherwise TIME_STEP() and TIMING_EVENT() compile to
+// nothing and the modules have no StepTiming at all.
+#ifdef MICROTOOLS_PROFILE
+#define TIME_STEP(timing) StepTimer step_timer(timing)
+#define TIMING_EVENT(timing, e) (timing).event(e)
+#else
+#define TIME_STEP(timing) ((void)0)
+#define TIMING_EVENT(timing, e) ((void)0)
+#endif
+
+#ifdef MICROTOOLS_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TIMING_X86 1
+#include <x86intrin.h>
+#endif
+
+// Buckets of the histogram. Bucket i counts the steps that took from 2^i to
+// 2^(i+1) ticks of the clock, and the last one anything longer.
+#define TIMING_BUCKETS 32
+
+// Rare things a step() can do, which are counted along with the longest step
+// each happened in
+enum TimingEvent {
+  TAKE_START,   // a Recorder hands a new take to its writer
+  TAKE_STOP,    // a Recorder has its writer finish the file
+  PREROLL_SWAP, // a Recorder adopts a new pre-roll buffer
+  RING_FULL,    // the writer fell behind and frames were dropped
+  COMMAND_FULL, // the writer hadn't taken the last starts and stops yet, so a
+                // take starts or stops a block late
+  PLAY_START,   // the Player has its reader seek to the start
+  NUM_TIMING_EVENTS,
+};
+
+const char *toString(TimingEvent event);
+
+// The clock read around each step(): the time stamp counter on x86, which
+// takes a few nanoseconds to read, nanoseconds elsewhere
+inline uint64_t timingTicks() {
+#ifdef TIMING_X86
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+// A copy of a StepTiming, with the ticks turned into nanoseconds
+struct TimingReport {
+  uint64_t steps = 0;
+  double total_ns = 0;
+  double worst_ns = 0;
+  double ns_per_tick = 1;
+  uint64_t buckets[TIMING_BUCKETS] = {};
+  uint64_t events[NUM_TIMING_EVENTS] = {};
+  double event_worst_ns[NUM_TIMING_EVENTS] = {};
+
+  // Where bucket `i` starts
+  double bucketNs(int i) const { return double(uint64_t(1) << i) * ns_per_tick; }
+
+  // `module` names the module in the files
+  void writeJson(FILE *f, const char *module) const;
+  void writeCsv(FILE *f, const char *module) const;
+};
+
+// A log-scale histogram of how long step() takes, with counters for the
+// rare events. Only the audio thread writes, so the counters are atomics
+// that it loads and stores without read-modify-write: recording a step is a
+// handful of plain moves, and the UI thread reads them whenever it likes.
+struct StepTiming {
+  StepTiming();
+
+  // Audio thread. Counts `event` in the step being timed.
+  void event(TimingEvent event) { pending |= 1 << event; }
+  void record(uint64_t ticks) {
+    if (reset_request.load(std::memory_order_relaxed)) {
+      clear();
+    }
+    int bucket = ticks ? 63 - __builtin_clzll(ticks) : 0;
+    bump(buckets[bucket < TIMING_BUCKETS ? bucket : TIMING_BUCKETS - 1]);
+    bump(steps);
+    total.store(total.load(std::memory_order_relaxed) + ticks,
+                std::memory_order_relaxed);
+    raise(worst, ticks);
+    if (pending) {
+      for (int e = 0; e < NUM_TIMING_EVENTS; e++) {
+        if (pending & (1 << e)) {
+          bump(events[e]);
+          raise(event_worst[e], ticks);
+        }
+      }
+      pending = 0;
+    }
+  }
+
+  // UI thread
+  TimingReport report() const;
+  // Starts over at the next step
+  void reset() { reset_request.store(true, std::memory_order_relaxed); }
+
+private:
+  typedef std::atomic<uint64_t> Counter;
+  Counter steps{0}, total{0}, worst{0};
+  Counter buckets[TIMING_BUCKETS] = {};
+  Counter events[NUM_TIMING_EVENTS] = {};
+  Counter event_worst[NUM_TIMING_EVENTS] = {};
+  int pending = 0; // events in the current step, audio thread
+  std::atomic<bool> reset_request{false};
+  // When the timing started, to convert ticks to nanoseconds
+  uint64_t start_ticks;
+  std::chrono::steady_clock::time_point start_time;
+
+  static void bump(Counter &c) {
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+  static void raise(Counter &c, uint64_t ticks) {
+    if (ticks > c.load(std::memory_order_relaxed)) {
+      c.store(ticks, std::memory_order_relaxed);
+    }
+  }
+  void clear();
+};
+
+// Times its scope, the body of a step()
+struct StepTimer {
+  StepTiming &timing;
+  uint64_t start;
+  explicit StepTimer(StepTiming &timing)
+      : timing(timing), start(timingTicks()) {}
+  ~StepTimer() { timing.record(timingTicks() - start); }
+};
+
+#endif
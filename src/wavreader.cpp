@@ -0,0 +1,202 @@
+#include "wavreader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// How much of the start of a file is read to find the header chunks
+#define HEADER_READ_SIZE (1 << 16)
+// How much is read at a time from files that aren't mapped
+#define READ_SIZE (1 << 18)
+// Largest data size a plain RIFF chunk size field can describe
+#define MAX_RIFF_SIZE 0xFFFFFFFFull
+
+static uint16_t le16(const uint8_t *p) { return p[0] | p[1] << 8; }
+
+static uint32_t le32(const uint8_t *p) {
+  return uint32_t(le16(p)) | uint32_t(le16(p + 2)) << 16;
+}
+
+static uint64_t le64(const uint8_t *p) {
+  return uint64_t(le32(p)) | uint64_t(le32(p + 4)) << 32;
+}
+
+// 64 bit file offsets, which plain fseek() doesn't have everywhere
+static int seek(FILE *f, uint64_t offset, int whence) {
+#ifdef _WIN32
+  return _fseeki64(f, offset, whence);
+#else
+  return fseeko(f, offset, whence);
+#endif
+}
+
+static uint64_t tell(FILE *f) {
+#ifdef _WIN32
+  return _ftelli64(f);
+#else
+  return ftello(f);
+#endif
+}
+
+bool readheader(const uint8_t *bytes, size_t size, uint64_t file_size,
+                WavInfo &info) {
+  if (size < 12 or memcmp(bytes + 8, "WAVE", 4) != 0) {
+    return false;
+  }
+  bool rf64 = memcmp(bytes, "RF64", 4) == 0;
+  if (not rf64 and memcmp(bytes, "RIFF", 4) != 0) {
+    return false;
+  }
+
+  uint64_t ds64_data_size = 0;
+  bool has_format = false;
+  size_t pos = 12;
+  while (pos + 8 <= size) {
+    const uint8_t *chunk = bytes + pos;
+    uint32_t chunk_size = le32(chunk + 4);
+    const uint8_t *body = chunk + 8;
+    bool in_buffer = pos + 8 + chunk_size <= size;
+
+    if (memcmp(chunk, "ds64", 4) == 0 and chunk_size >= 24 and in_buffer) {
+      ds64_data_size = le64(body + 8);
+    } else if (memcmp(chunk, "fmt ", 4) == 0 and chunk_size >= 16 and
+               in_buffer) {
+      int tag = le16(body);
+      info.num_channels = le16(body + 2);
+      info.sample_rate = le32(body + 4);
+      int bits = le16(body + 14);
+      if (tag == 0xFFFE and chunk_size >= 40) {
+        // WAVE_FORMAT_EXTENSIBLE, the real tag starts the subformat GUID
+        tag = le16(body + 24);
+      }
+      if (tag == 1 and bits == 8) {
+        info.format = SampleFmt::PCM_U8;
+      } else if (tag == 1 and bits == 16) {
+        info.format = SampleFmt::PCM_S16;
+      } else if (tag == 3 and bits == 32) {
+        info.format = SampleFmt::FLOAT_32;
+      } else {
+        return false;
+      }
+      has_format = info.num_channels > 0;
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      if (not has_format) {
+        return false;
+      }
+      info.data_offset = pos + 8;
+      uint64_t available =
+          file_size > info.data_offset ? file_size - info.data_offset : 0;
+      uint64_t data_size = rf64 and chunk_size == MAX_RIFF_SIZE
+                               ? ds64_data_size
+                               : chunk_size;
+      if (data_size == 0 or data_size > available) {
+        data_size = available;
+      }
+      info.samples =
+          data_size / (info.num_channels * sampleBytes(info.format));
+      return true;
+    }
+    // Chunks are padded to an even length
+    pos += 8 + uint64_t(chunk_size) + (chunk_size & 1);
+  }
+  return false;
+}
+
+void toVolts(SampleFmt format, const uint8_t *in, float *out, size_t n) {
+  switch (format) {
+  case SampleFmt::PCM_U8:
+    for (size_t i = 0; i < n; i++) {
+      out[i] = (in[i] - 128) * (12.0f / 127.0f);
+    }
+    break;
+  case SampleFmt::PCM_S16:
+    for (size_t i = 0; i < n; i++) {
+      int16_t sample;
+      memcpy(&sample, in + 2 * i, sizeof(sample));
+      out[i] = sample * (12.0f / 32767.0f);
+    }
+    break;
+  case SampleFmt::FLOAT_32:
+    for (size_t i = 0; i < n; i++) {
+      float sample;
+      memcpy(&sample, in + 4 * i, sizeof(sample));
+      out[i] = sample * 12.0f;
+    }
+    break;
+  default:
+    std::fill(out, out + n, 0.0f);
+  }
+}
+
+bool WavReader::open(const char *filename) {
+  close();
+  file = fopen(filename, "rb");
+  if (not file) {
+    return false;
+  }
+  seek(file, 0, SEEK_END);
+  uint64_t file_size = tell(file);
+  seek(file, 0, SEEK_SET);
+  bytes.resize(HEADER_READ_SIZE);
+  size_t size = fread(bytes.data(), 1, bytes.size(), file);
+  if (not readheader(bytes.data(), size, file_size, wav)) {
+    printf("%s isn't a WAV file this can play\n", filename);
+    close();
+    return false;
+  }
+
+#ifndef _WIN32
+  // Only map what can stay resident, otherwise reading it would just churn
+  // the page cache.
+  uint64_t memory = uint64_t(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+  if (file_size <= memory / 2) {
+    void *address =
+        mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+    if (address != MAP_FAILED) {
+      madvise(address, file_size, MADV_SEQUENTIAL);
+      map = static_cast<const uint8_t *>(address);
+      map_size = file_size;
+    }
+  }
+#endif
+  bytes.resize(map ? 0 : READ_SIZE);
+  bytes.shrink_to_fit();
+  return true;
+}
+
+void WavReader::close() {
+#ifndef _WIN32
+  if (map) {
+    munmap(const_cast<uint8_t *>(map), map_size);
+  }
+#endif
+  map = nullptr;
+  map_size = 0;
+  if (file) {
+    fclose(file);
+    file = nullptr;
+  }
+  wav = WavInfo();
+}
+
+size_t WavReader::read(uint64_t position, float *out, size_t n) {
+  if (not file or position >= wav.samples) {
+    return 0;
+  }
+  n = std::min<uint64_t>(n, wav.samples - position);
+  size_t frame_bytes = wav.num_channels * sampleBytes(wav.format);
+  uint64_t offset = wav.data_offset + position * frame_bytes;
+  if (map) {
+    toVolts(wav.format, map + offset, out, n * wav.num_channels);
+    return n;
+  }
+  n = std::min(n, bytes.size() / frame_bytes);
+  seek(file, offset, SEEK_SET);
+  size_t got = fread(bytes.data(), frame_bytes, n, file);
+  toVolts(wav.format, bytes.data(), out, got * wav.num_channels);
+  return got;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "wavwriter.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// What playing back a WAV file needs to know about it
+struct WavInfo {
+  SampleFmt format = SampleFmt::PCM_S16;
+  int num_channels = 0;
+  int sample_rate = 0;
+  uint64_t data_offset = 0; // where the first sample is, in bytes
+  uint64_t samples = 0;     // # of frames
+};
+
+// Parses the header of a WAV or RF64 file, of which the first `size` bytes
+// are in `bytes` and which is `file_size` bytes long. Handles the formats
+// writewav() produces: 8 bit unsigned, 16 bit signed and 32 bit float PCM,
+// plus their WAVE_FORMAT_EXTENSIBLE spellings. A data size that is missing or
+// runs past the end of the file (a take that was never finished) is taken to
+// be the rest of the file.
+bool readheader(const uint8_t *bytes, size_t size, uint64_t file_size,
+                WavInfo &info);
+
+// The inverse of convert(): `n` samples of `format` to volts.
+void toVolts(SampleFmt format, const uint8_t *in, float *out, size_t n);
+
+// Reads the audio of a WAV file. Opening only reads the header, so it takes
+// the same time however long the file is. Files that fit comfortably in
+// memory are memory mapped; larger ones are read a block at a time, so
+// streaming them doesn't evict everything else from the page cache.
+//
+// Reading blocks (on I/O or page faults), so keep it off the audio thread.
+struct WavReader {
+  ~WavReader() { close(); }
+
+  bool open(const char *filename);
+  void close();
+
+  bool isOpen() const { return file != nullptr; }
+  bool isMapped() const { return map != nullptr; }
+  const WavInfo &info() const { return wav; }
+
+  // Reads up to `n` frames from frame `position` on, as interleaved volts.
+  // Returns how many were read.
+  size_t read(uint64_t position, float *out, size_t n);
+
+private:
+  FILE *file = nullptr;
+  WavInfo wav;
+  const uint8_t *map = nullptr;
+  uint64_t map_size = 0;
+  std::vector<uint8_t> bytes; // read buffer, when not mapped
+};
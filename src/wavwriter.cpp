@@ -4,28 +4,48 @@
 
 #include <cassert>
 #include <cstdio>
+#include <cstring>
 
-#define SIZE_OF_HEADER 36
+// Everything in the header after the RIFF chunk size field:
+// "WAVE" + JUNK/ds64 chunk (8 + 28) + fmt chunk (8 + 16) + data chunk header (8)
+#define SIZE_OF_HEADER 72
+// The ds64 chunk: RIFF size, data size, sample count and an empty table
+#define SIZE_OF_DS64 28
+// Largest size a plain RIFF chunk size field can describe
+#define MAX_RIFF_SIZE 0xFFFFFFFFull
 
-void write(FILE *f, int size, int32_t arg) {
+// Appends a little endian integer of `size` bytes at `p`.
+void write(uint8_t *&p, int size, int64_t arg) {
   uint8_t x;
   int16_t y;
   int32_t z;
+  int64_t w;
 
   switch (size) {
   case 1:
     x = (uint8_t)arg;
-    fwrite(&x, size, 1, f);
+    memcpy(p, &x, size);
     break;
   case 2:
     y = (int16_t)arg;
-    fwrite(&y, size, 1, f);
+    memcpy(p, &y, size);
     break;
   case 4:
     z = (int32_t)arg;
-    fwrite(&z, size, 1, f);
+    memcpy(p, &z, size);
+    break;
+  case 8:
+    w = arg;
+    memcpy(p, &w, size);
     break;
   }
+  p += size;
+}
+
+// Appends a four character code at `p`.
+void write(uint8_t *&p, const char *id) {
+  memcpy(p, id, 4);
+  p += 4;
 }
 
 const char *toString(SampleFmt format) {
@@ -36,17 +56,33 @@ const char *toString(SampleFmt format) {
     return "16 bit signed";
   case SampleFmt::FLOAT_32:
     return "32 bit float";
+  case SampleFmt::FLAC_16:
+    return "16 bit FLAC";
+  default:
+    assert(not"an expected format");
+  }
+}
+
+int sampleBytes(SampleFmt format) {
+  switch (format) {
+  case SampleFmt::PCM_U8:
+    return 1;
+  case SampleFmt::PCM_S16:
+  case SampleFmt::FLAC_16:
+    return 2;
+  case SampleFmt::FLOAT_32:
+    return 4;
   default:
     assert(not"an expected format");
   }
 }
 
-void writewav(uint8_t *data, SampleFmt format, int num_channels, int samples,
-              int sample_rate, const char *filename) {
-  // Note: This is "write bytes" as to avoid Windows from sticking `0d = \r`
-  // before every `0a = \n` (CLRF vs LF line ending nonsense).
-  FILE *f = fopen(filename, "wb");
+int wavHeaderSize() { return 8 + SIZE_OF_HEADER; }
 
+// Fills `header` (wavHeaderSize() bytes) with a header for `samples` frames.
+static void makeheader(uint8_t *header, SampleFmt format, int num_channels,
+                       uint64_t samples, int sample_rate) {
+  uint8_t *f = header;
   int sample_bytes = 0;
   int wav_format = 0;
   switch (format) {
@@ -62,25 +98,82 @@ void writewav(uint8_t *data, SampleFmt format, int num_channels, int samples,
   default:
     assert(not"an expected format");
   }
-  int total_bytes = num_channels * sample_bytes * samples;
   int block_align = num_channels * sample_bytes;
+  uint64_t total_bytes = block_align * samples;
+  // Chunks are padded to an even length, the pad byte counts towards the RIFF
+  // size but not the data size.
+  uint64_t riff_bytes = SIZE_OF_HEADER + total_bytes + (total_bytes & 1);
+
+  // Past 4GB, switch to RF64 (EBU Tech 3306). The 32 bit sizes become -1 and
+  // the real ones go into the ds64 chunk. Smaller files reserve the same space
+  // with a JUNK chunk, so the header is always the same size and a streamed
+  // file can be upgraded in place when it is finalized.
+  bool rf64 = riff_bytes > MAX_RIFF_SIZE or total_bytes > MAX_RIFF_SIZE;
+
+  write(f, rf64 ? "RF64" : "RIFF");                /* main chunk       */
+  write(f, 4, rf64 ? MAX_RIFF_SIZE : riff_bytes);  /* chunk size       */
+  write(f, "WAVE");                                /* file format      */
+  write(f, rf64 ? "ds64" : "JUNK");                /* 64 bit sizes     */
+  write(f, 4, SIZE_OF_DS64);                       /* size of subchunk */
+  write(f, 8, rf64 ? riff_bytes : 0);              /* RIFF size        */
+  write(f, 8, rf64 ? total_bytes : 0);             /* data size        */
+  write(f, 8, rf64 ? samples : 0);                 /* # of frames      */
+  write(f, 4, 0);                                  /* table length     */
+  write(f, "fmt ");                                /* format chunk     */
+  write(f, 4, 16);                                 /* size of subchunk */
+  write(f, 2, wav_format);                         /* format           */
+  write(f, 2, num_channels);                       /* # of channels    */
+  write(f, 4, sample_rate);                        /* sample rate      */
+  write(f, 4, block_align * sample_rate);          /* byte rate        */
+  write(f, 2, block_align);                        /* block align      */
+  write(f, 2, 8 * sample_bytes);                   /* bits per sample  */
+  write(f, "data");                                /* data chunk       */
+  write(f, 4, rf64 ? MAX_RIFF_SIZE : total_bytes); /* size of subchunk */
+  assert(f - header == wavHeaderSize());
+}
+
+void writeheader(Sink &sink, SampleFmt format, int num_channels,
+                 uint64_t samples, int sample_rate) {
+  uint8_t header[8 + SIZE_OF_HEADER];
+  makeheader(header, format, num_channels, samples, sample_rate);
+  sink.write(header, sizeof(header));
+}
+
+void checkpointwav(Sink &sink, SampleFmt format, int num_channels,
+                   uint64_t samples, int sample_rate) {
+  uint8_t header[8 + SIZE_OF_HEADER];
+  makeheader(header, format, num_channels, samples, sample_rate);
+  sink.rewrite(0, header, sizeof(header));
+  sink.flush();
+}
+
+void finishwav(Sink &sink, SampleFmt format, int num_channels,
+               uint64_t samples, int sample_rate) {
+  if ((num_channels * sampleBytes(format) * samples) & 1) {
+    uint8_t pad = 0;
+    sink.write(&pad, 1);
+  }
+  uint8_t header[8 + SIZE_OF_HEADER];
+  makeheader(header, format, num_channels, samples, sample_rate);
+  sink.rewrite(0, header, sizeof(header));
+}
+
+void writewav(uint8_t *data, SampleFmt format, int num_channels,
+              uint64_t samples, int sample_rate, const char *filename,
+              SinkType sink_type) {
+  std::unique_ptr<Sink> sink = createSink(sink_type);
+  if (not sink->open(filename)) {
+    printf("Couldn't open %s for writing\n", filename);
+    return;
+  }
 
   /* header*/
-  fputs("RIFF", f);                          /* main chunk       */
-  write(f, 4, SIZE_OF_HEADER + total_bytes); /* chunk size       */
-  fputs("WAVE", f);                          /* file format      */
-  fputs("fmt ", f);                          /* format chunk     */
-  write(f, 4, 16);                           /* size of subchunk */
-  write(f, 2, wav_format);                   /* format           */
-  write(f, 2, num_channels);                 /* # of channels    */
-  write(f, 4, sample_rate);                  /* sample rate      */
-  write(f, 4, block_align * sample_rate);    /* byte rate        */
-  write(f, 2, block_align);                  /* block align      */
-  write(f, 2, 8 * sample_bytes);             /* bits per sample  */
-  fputs("data", f);                          /* data chunk       */
+  writeheader(*sink, format, num_channels, samples, sample_rate);
 
   /* body */
-  fwrite(data, 1, total_bytes, f); /* actual audio     */
+  size_t total_bytes = num_channels * sampleBytes(format) * samples;
+  sink->write(data, total_bytes); /* actual audio     */
+  finishwav(*sink, format, num_channels, samples, sample_rate);
 
-  fclose(f);
+  sink->close();
 }
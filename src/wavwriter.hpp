@@ -3,17 +3,47 @@
 #ifndef WAV_SYNTH_WAVWRITER_H_INCLUDED
 #define WAV_SYNTH_WAVWRITER_H_INCLUDED
 
+#include "sink.hpp"
+
 #include <cstdint>
 
 enum SampleFmt {
   PCM_U8,
   PCM_S16,
   FLOAT_32,
+  // Not a WAV format: 16 bit PCM, losslessly compressed (see flacencoder.hpp)
+  FLAC_16,
 };
 
 const char *toString(SampleFmt format);
 
-void writewav(uint8_t *data, SampleFmt format, int num_channels, int samples,
-              int sample_rate, const char *filename);
+// Size in bytes of a single sample of the given format (before compression)
+int sampleBytes(SampleFmt format);
+
+// Size in bytes of the header written by writeheader(). It doesn't depend on
+// the format or length, so a header can always be rewritten in place.
+int wavHeaderSize();
+
+// Appends a WAV header describing `samples` frames of audio to `sink`. The
+// audio data is expected to follow immediately after. Files whose sizes don't
+// fit in 32 bits are written as RF64.
+void writeheader(Sink &sink, SampleFmt format, int num_channels, uint64_t samples,
+                 int sample_rate);
+
+// Rewrites the header of a file still being streamed to describe the
+// `samples` frames appended so far, and flushes the sink. Done periodically,
+// it leaves a playable file behind if the process dies before finishwav().
+void checkpointwav(Sink &sink, SampleFmt format, int num_channels,
+                   uint64_t samples, int sample_rate);
+
+// Finalizes a streamed file whose audio has been appended after a placeholder
+// header: pads the data chunk if needed, and rewrites the header with the
+// final length. Doesn't close `sink`.
+void finishwav(Sink &sink, SampleFmt format, int num_channels,
+               uint64_t samples, int sample_rate);
+
+void writewav(uint8_t *data, SampleFmt format, int num_channels,
+              uint64_t samples, int sample_rate, const char *filename,
+              SinkType sink_type = SinkType::STDIO_SINK);
 
 #endif